@@ -0,0 +1,241 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightCache.h"
+#include "ULightCpp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define ULIGHT_HAVE_CLFLUSH 1
+#endif
+
+namespace ULightCpp
+{
+
+static const size_t CacheLineSize = 64;
+static const size_t MaxWorkingSet = size_t(512) << 20;
+static const int64_t MinSweepPointNs = 20000000;
+
+static size_t ParseCacheSize(const std::string& text)
+{
+	// sysfs sizes look like "48K" or "16M"
+	size_t size = std::strtoul(text.c_str(), nullptr, 10);
+	if (text.find('K') != std::string::npos)
+		size <<= 10;
+	else if (text.find('M') != std::string::npos)
+		size <<= 20;
+	return size;
+}
+
+static std::vector<ULightCacheLevel> ReadCacheLevels()
+{
+	std::vector<ULightCacheLevel> levels;
+	for (int index = 0; ; ++index)
+	{
+		std::stringstream dir;
+		dir << "/sys/devices/system/cpu/cpu0/cache/index" << index << "/";
+		std::ifstream levelFile(dir.str() + "level");
+		if (!levelFile)
+			break;
+		std::string type, size;
+		std::ifstream(dir.str() + "type") >> type;
+		std::ifstream(dir.str() + "size") >> size;
+		if (type == "Instruction")
+			continue;
+		ULightCacheLevel level;
+		levelFile >> level.level;
+		level.size = ParseCacheSize(size);
+		if (level.size > 0)
+			levels.push_back(level);
+	}
+
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+	if (levels.empty())
+	{
+		const int names[] = { _SC_LEVEL1_DCACHE_SIZE, _SC_LEVEL2_CACHE_SIZE, _SC_LEVEL3_CACHE_SIZE };
+		for (int i = 0; i < 3; ++i)
+		{
+			long size = sysconf(names[i]);
+			if (size > 0)
+				levels.push_back(ULightCacheLevel { i + 1, (size_t)size });
+		}
+	}
+#endif
+
+	if (levels.empty())
+	{
+		levels.push_back(ULightCacheLevel { 1, size_t(32) << 10 });
+		levels.push_back(ULightCacheLevel { 2, size_t(1) << 20 });
+		levels.push_back(ULightCacheLevel { 3, size_t(32) << 20 });
+	}
+	std::sort(levels.begin(), levels.end(), [](const ULightCacheLevel& a, const ULightCacheLevel& b) { return a.level < b.level; });
+	return levels;
+}
+
+const std::vector<ULightCacheLevel>& GetCacheLevels()
+{
+	static std::vector<ULightCacheLevel> levels = ReadCacheLevels();
+	return levels;
+}
+
+static std::vector<std::pair<const void *, size_t>> s_evictBuffers;
+static bool s_evictBuffersFrozen = false;
+static volatile char s_thrashSink;
+
+void RegisterEvictBuffer(const void *buffer, size_t size)
+{
+	// The list is fixed once the warm-up run is over, so registering from the
+	// body costs nothing per iteration and the same buffer is only added once
+	if (s_evictBuffersFrozen)
+		return;
+
+	auto entry = std::make_pair(buffer, size);
+	if (std::find(s_evictBuffers.begin(), s_evictBuffers.end(), entry) == s_evictBuffers.end())
+		s_evictBuffers.push_back(entry);
+}
+
+static void ThrashLastLevelCache()
+{
+	static std::vector<char> thrash(std::min(GetCacheLevels().back().size * 3 / 2, MaxWorkingSet));
+	char sum = 0;
+	for (size_t i = 0; i < thrash.size(); i += CacheLineSize)
+	{
+		thrash[i] += 1;
+		sum += thrash[i];
+	}
+	s_thrashSink = sum;
+}
+
+void EvictCaches()
+{
+#ifdef ULIGHT_HAVE_CLFLUSH
+	if (!s_evictBuffers.empty())
+	{
+		for (auto& buffer : s_evictBuffers)
+		{
+			const char *p = (const char *)buffer.first;
+			for (size_t offset = 0; offset < buffer.second; offset += CacheLineSize)
+				_mm_clflush(p + offset);
+		}
+		_mm_mfence();
+		return;
+	}
+#endif
+	ThrashLastLevelCache();
+}
+
+// Forgets the registered buffers however the cold run ends, so a body that
+// throws doesn't leave them for the next BENCHMARK_COLD
+class EvictBuffersReset
+{
+public:
+	EvictBuffersReset() { Reset(); }
+	~EvictBuffersReset() { Reset(); }
+
+	static void Reset()
+	{
+		s_evictBuffersFrozen = false;
+		s_evictBuffers.clear();
+	}
+};
+
+void RunCold(void (*fn)(), size_t iterations)
+{
+	EvictBuffersReset reset;
+	fn();
+	s_evictBuffersFrozen = true;
+
+	int64_t totalNs = 0;
+	for (size_t i = 0; i < iterations; ++i)
+	{
+		EvictCaches();
+		auto start = std::chrono::steady_clock::now();
+		fn();
+		auto end = std::chrono::steady_clock::now();
+		totalNs += std::max<int64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count() - GetCalibration().timerNs, 0);
+	}
+
+	ULightTestInfo *testInfo = GetTestHarness().GetCurrentTestInfo();
+	testInfo->benchmarked = true;
+	testInfo->benchmarkNs = totalNs;
+	testInfo->benchmarktime = totalNs / 1000;
+	if (totalNs > 0)
+		testInfo->itemsPerSecond = (int64_t)((1000000000.0 / totalNs) * iterations);
+}
+
+static std::wstring LevelFor(size_t bytes)
+{
+	for (auto& level : GetCacheLevels())
+	{
+		if (bytes <= level.size)
+		{
+			std::wstringstream str;
+			str << L"L" << level.level;
+			return str.str();
+		}
+	}
+	return L"RAM";
+}
+
+void RunSweep(void (*fn)(char *buffer, size_t bytes))
+{
+	const std::vector<ULightCacheLevel>& levels = GetCacheLevels();
+	size_t smallest = std::max<size_t>(levels.front().size / 2, 4096);
+	size_t largest = std::min(levels.back().size * 4, MaxWorkingSet);
+
+	std::vector<char> storage(largest + CacheLineSize);
+	char *buffer = storage.data() + (CacheLineSize - ((uintptr_t)storage.data() % CacheLineSize)) % CacheLineSize;
+	std::memset(buffer, 1, largest);
+
+	ULightTestInfo *testInfo = GetTestHarness().GetCurrentTestInfo();
+	testInfo->sweep.clear();
+	int64_t totalNs = 0;
+	for (size_t bytes = smallest; bytes <= largest; bytes *= 2)
+	{
+		// Untimed pass to bring the working set into the cache it fits in
+		fn(buffer, bytes);
+
+		size_t calls = 0;
+		int64_t elapsedNs = 0;
+		auto start = std::chrono::steady_clock::now();
+		while (elapsedNs < MinSweepPointNs || calls < 3)
+		{
+			fn(buffer, bytes);
+			++calls;
+			elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		ULightSweepPoint point;
+		point.bytes = bytes;
+		point.bytesPerSecond = ((double)bytes * calls) / (elapsedNs / 1000000000.0);
+		point.level = LevelFor(bytes);
+		testInfo->sweep.push_back(point);
+		totalNs += elapsedNs;
+	}
+	testInfo->benchmarked = true;
+	testInfo->benchmarkNs = totalNs;
+	testInfo->benchmarktime = totalNs / 1000;
+}
+
+}
@@ -0,0 +1,64 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightCache__
+#define __ULightCpp__ULightCache__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ULightCpp
+{
+
+struct ULightCacheLevel
+{
+	int level;
+	size_t size;
+};
+
+struct ULightSweepPoint
+{
+	size_t bytes;
+	double bytesPerSecond;
+	std::wstring level;		// Smallest cache the working set fits in, or "RAM"
+};
+
+// Data and unified caches of cpu0, smallest first
+const std::vector<ULightCacheLevel>& GetCacheLevels();
+
+// Adds a buffer to be flushed from the cache before each iteration of the
+// current BENCHMARK_COLD test.  Only registrations made during the warm-up run
+// are kept, and duplicates are ignored.  The buffer is flushed before every
+// timed run and must outlive the benchmark: flushing one that has been freed
+// and unmapped crashes.  Without one the whole last level cache is thrashed
+// instead.
+void RegisterEvictBuffer(const void *buffer, size_t size);
+
+void EvictCaches();
+
+// Runs fn once to warm up, then iterations more times with the caches evicted
+// before each, timing only the calls to fn
+void RunCold(void (*fn)(), size_t iterations);
+
+// Runs fn over working sets from half the L1 size to beyond the last level
+// cache and records the throughput at each size
+void RunSweep(void (*fn)(char *buffer, size_t bytes));
+
+}
+
+#endif // __ULightCpp__ULightCache__
@@ -0,0 +1,124 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightCheck.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace ULightCpp
+{
+
+std::atomic<uint64_t> g_checkGeneration(1);
+thread_local ULightCheckBuffer *t_checkBuffer = nullptr;
+thread_local uint64_t t_checkGeneration = 0;
+
+static std::mutex s_checkMutex;
+static std::vector<std::unique_ptr<ULightCheckBuffer>> s_buffers;
+// Buffers from earlier tests; a thread that has not yet noticed the new
+// generation may still hold one so they are never freed
+static std::vector<std::unique_ptr<ULightCheckBuffer>> s_retiredBuffers;
+
+ULightCheckBuffer *NewCheckBuffer()
+{
+	std::lock_guard<std::mutex> lck { s_checkMutex };
+	s_buffers.emplace_back(new ULightCheckBuffer());
+	t_checkBuffer = s_buffers.back().get();
+	t_checkGeneration = g_checkGeneration.load(std::memory_order_relaxed);
+	return t_checkBuffer;
+}
+
+static ULightCheckBuffer *CurrentBuffer()
+{
+	if (t_checkBuffer == nullptr || t_checkGeneration != g_checkGeneration.load(std::memory_order_relaxed))
+		return nullptr;
+	return t_checkBuffer;
+}
+
+uint64_t ThreadCheckFailures()
+{
+	ULightCheckBuffer *buffer = CurrentBuffer();
+	return buffer != nullptr ? buffer->failures : 0;
+}
+
+static std::wstring FixFileName(const std::wstring& filename)
+{
+	size_t pos = filename.find_last_of(L'/');
+	return pos == std::wstring::npos ? filename : filename.substr(pos + 1);
+}
+
+std::wstring ThreadCheckError(std::wstring& filename, int& lineNumber)
+{
+	ULightCheckBuffer *buffer = CurrentBuffer();
+	if (buffer == nullptr || buffer->used == 0)
+		return std::wstring();
+	const ULightCheckSlot& first = buffer->slots[0];
+	filename = FixFileName(first.site->filename);
+	lineNumber = first.site->lineNumber;
+	if (buffer->failures == first.count)
+		return first.message;
+	std::wstringstream str;
+	str << first.message << L" (and " << buffer->failures - first.count << L" more CHECK failures)";
+	return str.str();
+}
+
+void ResetChecks()
+{
+	std::lock_guard<std::mutex> lck { s_checkMutex };
+	for (auto& buffer : s_buffers)
+		s_retiredBuffers.push_back(std::move(buffer));
+	s_buffers.clear();
+	g_checkGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<ULightCheckResult> CollectChecks()
+{
+	std::lock_guard<std::mutex> lck { s_checkMutex };
+	std::vector<const ULightCheckSite *> sites;
+	std::vector<ULightCheckResult> results;
+	uint64_t dropped = 0;
+	for (auto& buffer : s_buffers)
+	{
+		dropped += buffer->dropped;
+		for (size_t i = 0; i < buffer->used; ++i)
+		{
+			const ULightCheckSlot& slot = buffer->slots[i];
+			size_t index = std::find(sites.begin(), sites.end(), slot.site) - sites.begin();
+			if (index == sites.size())
+			{
+				sites.push_back(slot.site);
+				results.push_back(ULightCheckResult());
+				results.back().filename = FixFileName(slot.site->filename);
+				results.back().lineNumber = slot.site->lineNumber;
+				results.back().message = slot.message;
+			}
+			results[index].count += slot.count;
+			++results[index].threads;
+		}
+	}
+	if (dropped > 0)
+	{
+		ULightCheckResult other;
+		other.count = dropped;
+		other.message = L"failures at sites beyond the per-thread limit";
+		results.push_back(other);
+	}
+	return results;
+}
+
+}
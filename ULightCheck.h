@@ -0,0 +1,114 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightCheck__
+#define __ULightCpp__ULightCheck__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ULightCpp
+{
+
+// One per CHECK in the source; a static in the macro so its address
+// identifies the site
+struct ULightCheckSite
+{
+	const wchar_t *filename;
+	int lineNumber;
+};
+
+static const size_t ULightMaxCheckSites = 16;
+
+struct ULightCheckSlot
+{
+	const ULightCheckSite *site;
+	uint64_t count;
+	std::wstring message;	// Formatted on the first failure at the site
+};
+
+// One per thread.  Failures at more distinct sites than there are slots are
+// only counted.
+struct ULightCheckBuffer
+{
+	ULightCheckBuffer() : used(0), failures(0), dropped(0) {}
+
+	ULightCheckSlot slots[ULightMaxCheckSites];
+	size_t used;
+	uint64_t failures;
+	uint64_t dropped;
+};
+
+// All failures at one site during a test, across threads.  Failures that
+// did not fit in a thread's buffer are totalled in a result with no location.
+struct ULightCheckResult
+{
+	ULightCheckResult() : lineNumber(0), count(0), threads(0) {}
+
+	std::wstring filename;
+	int lineNumber;
+	uint64_t count;
+	size_t threads;
+	std::wstring message;
+};
+
+ULightCheckBuffer *NewCheckBuffer();
+
+extern std::atomic<uint64_t> g_checkGeneration;
+extern thread_local ULightCheckBuffer *t_checkBuffer;
+extern thread_local uint64_t t_checkGeneration;
+
+// Counts a failure at site.  Returns the slot whose message still needs
+// formatting on the first failure at the site, otherwise nullptr.
+inline ULightCheckSlot *CheckFailed(const ULightCheckSite *site)
+{
+	ULightCheckBuffer *buffer = t_checkBuffer;
+	if (buffer == nullptr || t_checkGeneration != g_checkGeneration.load(std::memory_order_relaxed))
+		buffer = NewCheckBuffer();
+	++buffer->failures;
+	for (size_t i = 0; i < buffer->used; ++i)
+	{
+		if (buffer->slots[i].site == site)
+		{
+			++buffer->slots[i].count;
+			return nullptr;
+		}
+	}
+	if (buffer->used == ULightMaxCheckSites)
+	{
+		++buffer->dropped;
+		return nullptr;
+	}
+	ULightCheckSlot& slot = buffer->slots[buffer->used++];
+	slot.site = site;
+	slot.count = 1;
+	return &slot;
+}
+
+// Failures recorded by the calling thread during this test, and the first
+// of them as an error message
+uint64_t ThreadCheckFailures();
+std::wstring ThreadCheckError(std::wstring& filename, int& lineNumber);
+
+// Called by the harness around each test
+void ResetChecks();
+std::vector<ULightCheckResult> CollectChecks();
+
+}
+
+#endif // __ULightCpp__ULightCheck__
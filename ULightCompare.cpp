@@ -0,0 +1,136 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightCompare.h"
+#include "ULightTestTimer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+namespace ULightCpp
+{
+
+static int64_t TimeBatch(const std::function<void()>& fn, size_t batchSize)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < batchSize; ++i)
+		fn();
+	auto end = std::chrono::steady_clock::now();
+	// Take out the cost of the calls themselves so it doesn't dilute the
+	// difference between two fast functions
+	const ULightCalibration& calibration = GetCalibration();
+	int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()
+		- calibration.timerNs - calibration.dispatchNs * (int64_t)batchSize;
+	return std::max<int64_t>(ns, 1);
+}
+
+static double Median(std::vector<double> values)
+{
+	if (values.empty())
+		return 0;
+	size_t mid = values.size() / 2;
+	std::nth_element(values.begin(), values.begin() + mid, values.end());
+	double upper = values[mid];
+	if (values.size() % 2 == 1)
+		return upper;
+	double lower = *std::max_element(values.begin(), values.begin() + mid);
+	return (lower + upper) / 2.0;
+}
+
+// Sized for one function at a time; a shared size would make the slower of
+// two very different functions run far longer than minBatchUs every round
+static size_t CalibrateBatch(const std::function<void()>& fn, int64_t minBatchUs)
+{
+	const int64_t minBatchNs = minBatchUs * 1000;
+	size_t batchSize = 1;
+	while (batchSize < (size_t(1) << 30) && TimeBatch(fn, batchSize) < minBatchNs)
+		batchSize *= 2;
+	return batchSize;
+}
+
+ULightCompareResult Compare(std::function<void()> baseline, std::function<void()> candidate, const ULightCompareOptions& options)
+{
+	ULightCompareResult result;
+	result.baselineBatch = CalibrateBatch(baseline, options.minBatchUs);
+	result.candidateBatch = CalibrateBatch(candidate, options.minBatchUs);
+	result.rounds = std::max<size_t>(options.rounds, 2);
+
+	std::mt19937_64 rng(std::random_device{}());
+	std::bernoulli_distribution coin(0.5);
+
+	std::vector<double> ratios;
+	std::vector<double> baselineTimes;
+	std::vector<double> candidateTimes;
+	ratios.reserve(result.rounds);
+	baselineTimes.reserve(result.rounds);
+	candidateTimes.reserve(result.rounds);
+
+	// One discarded round so both sides start from the same warmed state
+	for (size_t round = 0; round <= result.rounds; ++round)
+	{
+		int64_t a, b;
+		if (coin(rng))
+		{
+			a = TimeBatch(baseline, result.baselineBatch);
+			b = TimeBatch(candidate, result.candidateBatch);
+		}
+		else
+		{
+			b = TimeBatch(candidate, result.candidateBatch);
+			a = TimeBatch(baseline, result.baselineBatch);
+		}
+		if (round == 0 || b <= 0)
+			continue;
+		// Per call, since the two batches differ in size
+		double baselineNs = (double)a / result.baselineBatch;
+		double candidateNs = (double)b / result.candidateBatch;
+		ratios.push_back(baselineNs / candidateNs);
+		baselineTimes.push_back(baselineNs);
+		candidateTimes.push_back(candidateNs);
+	}
+
+	result.speedup = Median(ratios);
+	result.baselineNs = Median(baselineTimes);
+	result.candidateNs = Median(candidateTimes);
+
+	// Percentile bootstrap of the median ratio
+	std::vector<double> medians;
+	medians.reserve(options.resamples);
+	std::vector<double> sample(ratios.size());
+	std::uniform_int_distribution<size_t> pick(0, ratios.empty() ? 0 : ratios.size() - 1);
+	for (size_t r = 0; r < options.resamples && !ratios.empty(); ++r)
+	{
+		for (auto& s : sample)
+			s = ratios[pick(rng)];
+		medians.push_back(Median(sample));
+	}
+	if (medians.empty())
+	{
+		result.speedupLow = result.speedupHigh = result.speedup;
+		return result;
+	}
+	std::sort(medians.begin(), medians.end());
+	double tail = (1.0 - options.confidence) / 2.0;
+	size_t lo = (size_t)(tail * (medians.size() - 1));
+	size_t hi = (size_t)((1.0 - tail) * (medians.size() - 1));
+	result.speedupLow = medians[lo];
+	result.speedupHigh = medians[hi];
+	return result;
+}
+
+}
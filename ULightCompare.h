@@ -0,0 +1,64 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightCompare__
+#define __ULightCpp__ULightCompare__
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+namespace ULightCpp
+{
+
+struct ULightCompareOptions
+{
+	ULightCompareOptions()
+	 :	rounds(40), minBatchUs(2000), resamples(2000), confidence(0.95)
+		{}
+
+	size_t rounds;		// Number of interleaved baseline/candidate rounds
+	int64_t minBatchUs;	// Each timed batch runs at least this long
+	size_t resamples;	// Bootstrap resamples for the confidence interval
+	double confidence;	// Width of the confidence interval (e.g. 0.95)
+};
+
+struct ULightCompareResult
+{
+	ULightCompareResult()
+	 :	speedup(0), speedupLow(0), speedupHigh(0), baselineNs(0), candidateNs(0), baselineBatch(0), candidateBatch(0), rounds(0)
+		{}
+
+	double speedup;		// Median of baseline/candidate per round; > 1 means the candidate is faster
+	double speedupLow;
+	double speedupHigh;
+	double baselineNs;	// Median nanoseconds per call
+	double candidateNs;
+	size_t baselineBatch;	// Calls per timed batch, sized separately so each side runs about minBatchUs
+	size_t candidateBatch;
+	size_t rounds;
+
+	bool Significant() const { return speedupLow > 1.0 || speedupHigh < 1.0; }
+};
+
+// Runs baseline and candidate in alternating batches on the calling thread.  The
+// order within each round is randomised so that neither side is systematically
+// advantaged by running first (cache warmth, frequency ramps, etc.).
+ULightCompareResult Compare(std::function<void()> baseline, std::function<void()> candidate, const ULightCompareOptions& options);
+
+}
+
+#endif // __ULightCpp__ULightCompare__
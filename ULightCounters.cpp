@@ -0,0 +1,207 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightCounters.h"
+#include "ULightCpp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <sstream>
+
+namespace ULightCpp
+{
+
+std::atomic<uint64_t> g_counterGeneration(1);
+thread_local ULightCounterShard *t_counterShard = nullptr;
+thread_local uint64_t t_counterGeneration = 0;
+
+static std::mutex s_counterMutex;
+static std::vector<std::wstring> s_counterNames;
+static std::vector<std::unique_ptr<ULightCounterShard>> s_shards;
+// Shards from earlier tests; a thread that has not yet noticed the new
+// generation may still hold one so they are never freed
+static std::vector<std::unique_ptr<ULightCounterShard>> s_retiredShards;
+
+ULightCounterShard::ULightCounterShard()
+{
+	for (auto& value : values)
+		value.store(0, std::memory_order_relaxed);
+}
+
+size_t CounterId(const wchar_t *name, const wchar_t *filename, int lineNumber)
+{
+	std::lock_guard<std::mutex> lck { s_counterMutex };
+	auto it = std::find(s_counterNames.begin(), s_counterNames.end(), name);
+	if (it != s_counterNames.end())
+		return it - s_counterNames.begin();
+	if (s_counterNames.size() == ULightMaxCounters)
+	{
+		std::wstringstream str;
+		str << L"Too many COUNT names; " << name << L" does not fit in the " << ULightMaxCounters << L" counters";
+		throw UnitTestException(str.str(), filename, lineNumber);
+	}
+	s_counterNames.push_back(name);
+	return s_counterNames.size() - 1;
+}
+
+ULightCounterShard *NewCounterShard()
+{
+	std::lock_guard<std::mutex> lck { s_counterMutex };
+	s_shards.emplace_back(new ULightCounterShard());
+	t_counterShard = s_shards.back().get();
+	t_counterGeneration = g_counterGeneration.load(std::memory_order_relaxed);
+	return t_counterShard;
+}
+
+static void ResetCounters()
+{
+	std::lock_guard<std::mutex> lck { s_counterMutex };
+	for (auto& shard : s_shards)
+		s_retiredShards.push_back(std::move(shard));
+	s_shards.clear();
+	g_counterGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+static std::vector<uint64_t> SumCounters()
+{
+	std::lock_guard<std::mutex> lck { s_counterMutex };
+	std::vector<uint64_t> totals(s_counterNames.size(), 0);
+	for (auto& shard : s_shards)
+	{
+		for (size_t id = 0; id < totals.size(); ++id)
+			totals[id] += shard->values[id].load(std::memory_order_relaxed);
+	}
+	return totals;
+}
+
+ULightCounterSampler::ULightCounterSampler() : m_stop(false), m_intervalMs(100)
+{
+}
+
+ULightCounterSampler::~ULightCounterSampler()
+{
+	if (m_thread.joinable())
+		Stop();
+}
+
+void ULightCounterSampler::Sample(int64_t elapsedMs)
+{
+	m_snapshots.push_back(SumCounters());
+	m_timesMs.push_back(elapsedMs);
+}
+
+void ULightCounterSampler::Start(int64_t intervalMs)
+{
+	ResetCounters();
+	m_stop = false;
+	m_intervalMs = std::max<int64_t>(intervalMs, 1);
+	m_snapshots.clear();
+	m_timesMs.clear();
+	Sample(0);
+
+	m_thread = std::thread([this]()
+	{
+		auto start = std::chrono::steady_clock::now();
+		auto next = start;
+		std::unique_lock<std::mutex> lck { m_mutex };
+		for (;;)
+		{
+			next += std::chrono::milliseconds(m_intervalMs);
+			if (m_wake.wait_until(lck, next, [this]() { return m_stop; }))
+				break;
+			Sample(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+		}
+		// Final partial interval
+		int64_t elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+		if (elapsedMs > m_timesMs.back())
+			Sample(elapsedMs);
+	});
+}
+
+static double Median(std::vector<double> values)
+{
+	std::sort(values.begin(), values.end());
+	return values.empty() ? 0 : values[values.size() / 2];
+}
+
+std::vector<ULightCounterTimeline> ULightCounterSampler::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lck { m_mutex };
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	m_thread.join();
+
+	std::vector<std::wstring> names;
+	{
+		std::lock_guard<std::mutex> lck { s_counterMutex };
+		names = s_counterNames;
+	}
+
+	std::vector<ULightCounterTimeline> timelines;
+	const std::vector<uint64_t>& last = m_snapshots.back();
+	for (size_t id = 0; id < last.size(); ++id)
+	{
+		if (last[id] == 0)
+			continue;
+
+		ULightCounterTimeline timeline;
+		timeline.name = names[id];
+		timeline.total = last[id];
+		for (size_t i = 1; i < m_snapshots.size(); ++i)
+		{
+			uint64_t before = id < m_snapshots[i - 1].size() ? m_snapshots[i - 1][id] : 0;
+			uint64_t after = id < m_snapshots[i].size() ? m_snapshots[i][id] : 0;
+			int64_t ms = std::max<int64_t>(m_timesMs[i] - m_timesMs[i - 1], 1);
+			timeline.rates.push_back((after - before) * 1000.0 / ms);
+			timeline.timesMs.push_back(m_timesMs[i]);
+		}
+		if (timeline.rates.empty())
+			continue;
+
+		timeline.minRate = *std::min_element(timeline.rates.begin(), timeline.rates.end());
+		timeline.maxRate = *std::max_element(timeline.rates.begin(), timeline.rates.end());
+		double sum = 0;
+		for (double rate : timeline.rates)
+			sum += rate;
+		timeline.meanRate = sum / timeline.rates.size();
+		double squares = 0;
+		for (double rate : timeline.rates)
+			squares += (rate - timeline.meanRate) * (rate - timeline.meanRate);
+		timeline.stddevRate = std::sqrt(squares / timeline.rates.size());
+
+		// Ignore the first tenth of the run as warm up, and the last sample as
+		// it is usually a partial interval while threads wind down
+		double median = Median(timeline.rates);
+		size_t warmup = std::max<size_t>(timeline.rates.size() / 10, 1);
+		for (size_t i = warmup; i + 1 < timeline.rates.size(); ++i)
+		{
+			if (timeline.rates[i] < median * 0.25)
+			{
+				timeline.collapsed = true;
+				timeline.collapseMs = timeline.timesMs[i];
+				break;
+			}
+		}
+		timelines.push_back(timeline);
+	}
+	return timelines;
+}
+
+}
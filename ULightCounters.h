@@ -0,0 +1,104 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightCounters__
+#define __ULightCpp__ULightCounters__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ULightCpp
+{
+
+static const size_t ULightMaxCounters = 64;
+
+// One per thread.  The padding keeps neighbouring heap allocations off the
+// cache lines COUNT writes to.
+struct ULightCounterShard
+{
+	ULightCounterShard();
+	char paddingBefore[64];
+	std::atomic<uint64_t> values[ULightMaxCounters];
+	char paddingAfter[64];
+};
+
+struct ULightCounterTimeline
+{
+	ULightCounterTimeline()
+	 :	total(0), minRate(0), maxRate(0), meanRate(0), stddevRate(0), collapsed(false), collapseMs(0)
+		{}
+
+	std::wstring name;
+	std::vector<double> rates;		// Per second, one per sample interval
+	std::vector<int64_t> timesMs;	// End of each sample since the sampler started
+	uint64_t total;
+	double minRate;
+	double maxRate;
+	double meanRate;
+	double stddevRate;
+	bool collapsed;					// Throughput dropped far below the median after warm up
+	int64_t collapseMs;
+};
+
+// Throws UnitTestException at the COUNT site once ULightMaxCounters names are
+// taken, rather than adding into another counter
+size_t CounterId(const wchar_t *name, const wchar_t *filename, int lineNumber);
+
+ULightCounterShard *NewCounterShard();
+
+extern std::atomic<uint64_t> g_counterGeneration;
+extern thread_local ULightCounterShard *t_counterShard;
+extern thread_local uint64_t t_counterGeneration;
+
+inline void CounterAdd(size_t id, uint64_t count)
+{
+	ULightCounterShard *shard = t_counterShard;
+	if (shard == nullptr || t_counterGeneration != g_counterGeneration.load(std::memory_order_relaxed))
+		shard = NewCounterShard();
+	// Each shard has a single writer so load/store is enough
+	std::atomic<uint64_t>& value = shard->values[id];
+	value.store(value.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+}
+
+// Snapshots all counters at a fixed interval while a test runs
+class ULightCounterSampler
+{
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	bool m_stop;
+	int64_t m_intervalMs;
+	std::vector<std::vector<uint64_t>> m_snapshots;
+	std::vector<int64_t> m_timesMs;
+
+	void Sample(int64_t elapsedMs);
+public:
+	ULightCounterSampler();
+	~ULightCounterSampler();
+
+	// Clears all counters and starts sampling
+	void Start(int64_t intervalMs);
+	std::vector<ULightCounterTimeline> Stop();
+};
+
+}
+
+#endif // __ULightCpp__ULightCounters__
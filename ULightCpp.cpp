@@ -22,6 +22,11 @@
 #include <sstream>
 #include <vector>
 #include <algorithm>
+#include <cwchar>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <map>
 #include <sys/time.h>
 #include <sys/times.h>
 
@@ -95,8 +100,164 @@ static std::wstring MakeNumberPrettyNumber(int64_t val)
 	return s;
 }
 
+static std::wstring MakeBytesPretty(double bytes)
+{
+	const wchar_t *units[] = { L"B", L"KB", L"MB", L"GB", L"TB" };
+	int unit = 0;
+	while (bytes >= 1024.0 && unit < 4)
+		bytes /= 1024.0, ++unit;
+	std::wstringstream sstr;
+	sstr << std::fixed << std::setprecision(bytes < 10.0 && unit > 0 ? 1 : 0) << bytes << L" " << units[unit];
+	return sstr.str();
+}
+
+static void ReportSweep(std::wostream& os, const std::vector<ULightSweepPoint>& sweep)
+{
+	double previous = 0;
+	for (auto& point : sweep)
+	{
+		os << std::setw(12) << MakeBytesPretty((double)point.bytes) << L" " << std::setw(4) << point.level
+			<< std::setw(14) << MakeBytesPretty(point.bytesPerSecond) << L"/s";
+		// Flag a drop of more than a third from the previous size
+		if (previous > 0 && point.bytesPerSecond < previous * 2.0 / 3.0)
+			os << L"  <- cliff";
+		os << std::endl;
+		previous = point.bytesPerSecond;
+	}
+}
+
+static void ReportPhases(std::wostream& os, const std::vector<ULightPhaseStat>& phases)
+{
+	for (auto& phase : phases)
+	{
+		os << std::setw(12) << MakeNumberPrettyNumber(phase.calls) << L" calls"
+			<< std::setw(12) << MakeNumberPrettyNumber(phase.inclusiveNs / 1000) << L"us incl"
+			<< std::setw(12) << MakeNumberPrettyNumber(phase.exclusiveNs / 1000) << L"us excl"
+			<< std::setw(12) << MakeNumberPrettyNumber(phase.inclusiveNs / std::max<int64_t>(phase.calls, 1)) << L"ns/call  "
+			<< std::wstring(phase.depth * 2, L' ') << phase.name << std::endl;
+	}
+}
+
+static std::wstring MakeRateShort(double rate)
+{
+	const wchar_t *suffixes[] = { L"", L"k", L"M", L"G" };
+	int suffix = 0;
+	while (rate >= 1000.0 && suffix < 3)
+		rate /= 1000.0, ++suffix;
+	std::wstringstream sstr;
+	sstr << std::fixed << std::setprecision(rate < 10.0 && suffix > 0 ? 1 : 0) << rate << suffixes[suffix];
+	return sstr.str();
+}
+
+static void ReportCounters(std::wostream& os, const std::wstring& testName, const std::vector<ULightCounterTimeline>& counters)
+{
+	const size_t MaxColumns = 20;
+	if (!counters.empty())
+		os << L"Throughput " << testName << L":" << std::endl;
+	for (auto& timeline : counters)
+	{
+		double cv = timeline.meanRate > 0 ? 100.0 * timeline.stddevRate / timeline.meanRate : 0;
+		os << std::setw(12) << timeline.name << L" total " << MakeNumberPrettyNumber(timeline.total)
+			<< L"  mean " << MakeRateShort(timeline.meanRate) << L"/s"
+			<< L"  min " << MakeRateShort(timeline.minRate) << L"/s"
+			<< L"  max " << MakeRateShort(timeline.maxRate) << L"/s"
+			<< L"  cv " << std::fixed << std::setprecision(1) << cv << L"%" << std::endl;
+		os.unsetf(std::ios::floatfield);
+
+		// Long runs are averaged into at most MaxColumns buckets
+		size_t perColumn = (timeline.rates.size() + MaxColumns - 1) / MaxColumns;
+		os << std::setw(12) << L"" << L" ops/s";
+		for (size_t i = 0; i < timeline.rates.size(); i += perColumn)
+		{
+			size_t end = std::min(i + perColumn, timeline.rates.size());
+			double sum = 0;
+			for (size_t j = i; j < end; ++j)
+				sum += timeline.rates[j];
+			os << L" " << MakeRateShort(sum / (end - i));
+		}
+		os << std::endl;
+	}
+}
+
+static void ReportRates(std::wostream& os, const std::wstring& testName, const std::vector<ULightRateResults>& rates)
+{
+	for (auto& rate : rates)
+	{
+		os << L"Open loop " << testName << L"/" << rate.name << L":" << std::endl
+			<< L"  target " << MakeRateShort(rate.targetRate) << L"/s  achieved " << MakeRateShort(rate.achievedRate) << L"/s"
+			<< L"  completed " << MakeNumberPrettyNumber(rate.completed) << L"/" << MakeNumberPrettyNumber(rate.targetOps)
+			<< L"  errors " << MakeNumberPrettyNumber(rate.errors) << std::endl
+			<< std::fixed << std::setprecision(1)
+			<< L"  latency p50 " << rate.p50Us << L"us  p90 " << rate.p90Us << L"us  p99 " << rate.p99Us
+			<< L"us  p99.9 " << rate.p999Us << L"us  max " << rate.maxUs << L"us" << std::endl;
+		os.unsetf(std::ios::floatfield);
+		if (rate.saturationRate > 0)
+			os << L"  Saturated at about " << MakeRateShort(rate.saturationRate) << L"/s" << std::endl;
+		if (rate.achievedRate < rate.targetRate * 0.95)
+			os << L"  Warning: achieved rate is below target, the system under test is saturated" << std::endl;
+	}
+}
+
+static void ReportNets(std::wostream& os, const std::wstring& testName, const std::vector<ULightNetResults>& nets)
+{
+	for (auto& net : nets)
+	{
+		double seconds = net.elapsedUs / 1000000.0;
+		os << L"Clients " << testName << L"/" << net.name << L":" << std::endl
+			<< L"  connections " << MakeNumberPrettyNumber(net.connections) << L"  failed " << MakeNumberPrettyNumber(net.failedConnections)
+			<< L"  requests " << MakeNumberPrettyNumber(net.requests)
+			<< L"  " << MakeRateShort(seconds > 0 ? net.requests / seconds : 0) << L"/s" << std::endl
+			<< std::fixed << std::setprecision(1)
+			<< L"  latency p50 " << net.p50Us << L"us  p99 " << net.p99Us << L"us  max " << net.maxUs << L"us" << std::endl;
+		os.unsetf(std::ios::floatfield);
+	}
+}
+
+static std::wstring MakeMsPretty(int64_t ns)
+{
+	return ns < 0 ? L"n/a" : MakeNumberPrettyNumber(ns / 1000000) + L"ms";
+}
+
+static std::wstring MakeCountPretty(int64_t count)
+{
+	return count < 0 ? L"n/a" : MakeNumberPrettyNumber(count);
+}
+
+static const int64_t MinOversubscribedWaitNs = 5000000;
+
+static void ReportSched(std::wostream& os, const std::wstring& testName, const std::vector<ULightTaskSched>& sched)
+{
+	for (auto& task : sched)
+	{
+		const ULightSchedSample& total = task.total;
+		// Whatever a thread spent neither running nor runnable it spent blocked
+		int64_t blockedNs = total.cpuNs >= 0 && total.waitNs >= 0 ? std::max<int64_t>(total.wallNs - total.cpuNs - total.waitNs, 0) : -1;
+		os << L"Threads " << testName << L"/" << task.name << L": " << task.threads << L" threads" << std::endl
+			<< L"  on cpu " << MakeMsPretty(total.cpuNs) << L"  waiting for cpu " << MakeMsPretty(total.waitNs)
+			<< L"  blocked " << MakeMsPretty(blockedNs) << std::endl
+			<< L"  switches " << MakeCountPretty(total.voluntary) << L" voluntary " << MakeCountPretty(total.involuntary) << L" involuntary"
+			<< L"  migrations " << MakeCountPretty(total.migrations) << std::endl;
+		// Open loop and client threads sleep until their next operation or
+		// socket event, and pick up wake-up latency as run queue wait, so
+		// neither warning applies to them
+		if (task.paced)
+			continue;
+		// A thread that wakes up often waits a little for a cpu each time even
+		// on an idle machine, so the wait must also be a real share of the run
+		if (total.cpuNs > 0 && total.waitNs > total.cpuNs / 4 && total.waitNs > MinOversubscribedWaitNs
+			&& total.waitNs > total.wallNs / 10)
+			os << L"  Warning: threads spent a lot of time waiting for a cpu; the test is oversubscribed" << std::endl;
+		// Sleeping and waiting on I/O also block and switch voluntarily, but a
+		// convoy forms when lock holders get preempted, so it needs involuntary
+		// switches too
+		if (blockedNs > total.wallNs / 2 && total.voluntary > (int64_t)task.threads * 100
+			&& total.involuntary * 10 > total.voluntary)
+			os << L"  Warning: threads were mostly blocked and switched often; unless the task waits on I/O, look for lock contention" << std::endl;
+	}
+}
+
 ULightTests::ULightTests()
- : outStream(nullptr), m_elapsedTime(0), m_benchmarks(false), m_reports(false), m_verbose(false), m_runStressTests(false), m_currentTest(nullptr)
+ : outStream(nullptr), m_elapsedTime(0), m_benchmarks(false), m_reports(false), m_verbose(false), m_runStressTests(false), m_pinThread(false), m_pinCpu(-1), m_sampleIntervalMs(100), m_shardIndex(0), m_shardCount(0), m_listTests(false), m_merge(false), m_traceEvents(1000000), m_currentTest(nullptr)
 {
     //ctor
 }
@@ -132,10 +293,23 @@ void ULightTests::AddTestTeardown(std::wstring testName_, std::function<void()>
 	testInfo->testTeardown = testFn_;
 }
 
-void ULightTests::AddTask(std::wstring testName_, std::function<void()> testFn_, size_t count)
+void ULightTests::AddTask(std::wstring testName_, std::function<void()> testFn_, size_t count, std::wstring taskName_)
+{
+	ULightTestInfo *testInfo = FindOrCreateTestInfo(m_tests, testName_);
+	testInfo->threadStarter.add(testFn_, count, taskName_);
+}
+
+void ULightTests::AddNetTask(std::wstring testName_, std::wstring taskName_, std::function<ULightNetClients()> clientsFn_)
+{
+	ULightTestInfo *testInfo = FindOrCreateTestInfo(m_tests, testName_);
+	testInfo->threadStarter.add_net(std::shared_ptr<ULightNetDriver>(new ULightNetDriver(taskName_, clientsFn_)));
+}
+
+void ULightTests::AddRateTask(std::wstring testName_, std::wstring taskName_, std::function<void()> testFn_, size_t count, double startRate, double endRate, int64_t durationMs)
 {
 	ULightTestInfo *testInfo = FindOrCreateTestInfo(m_tests, testName_);
-	testInfo->threadStarter.add(testFn_, count);
+	std::shared_ptr<ULightOpenLoop> openLoop(new ULightOpenLoop(taskName_, testFn_, startRate, endRate, durationMs));
+	testInfo->threadStarter.add_rate(openLoop, count);
 }
 
 void ULightTests::AddTest(std::wstring testName_, std::function<void()> testFn_, bool stressTest_)
@@ -145,8 +319,26 @@ void ULightTests::AddTest(std::wstring testName_, std::function<void()> testFn_,
 	testInfo->stressTest = stressTest_;
 }
 
+// Name of the trace span for a stage, or 0 if tracing is off or the stage
+// has nothing to run
+static uint32_t TraceStageName(ULightTestStage stage, ULightTestInfo& testInfo)
+{
+	if (!g_traceEnabled.load(std::memory_order_relaxed))
+		return 0;
+	if (stage == ULightTestStage::Setup && testInfo.testSetup)
+		return TraceName(L"Setup");
+	if (stage == ULightTestStage::Task && testInfo.threadStarter.has_tasks())
+		return TraceName(L"Task");
+	if (stage == ULightTestStage::Run && testInfo.testFn)
+		return TraceName(L"Run");
+	if (stage == ULightTestStage::Teardown && testInfo.testTeardown)
+		return TraceName(L"Teardown");
+	return 0;
+}
+
 static void RunTestFn(ULightTestStage stage, ULightTestInfo& testInfo, bool runStressTests)
 {
+	ULightTraceSpan span(ULightTraceCategory::Stage, TraceStageName(stage, testInfo), g_traceTest.load(std::memory_order_relaxed));
     try
     {
 		if (!runStressTests && testInfo.stressTest)
@@ -158,6 +350,9 @@ static void RunTestFn(ULightTestStage stage, ULightTestInfo& testInfo, bool runS
 		else if (stage == ULightTestStage::Task && testInfo.threadStarter.has_tasks())
 		{
 			ULightRunResults results = testInfo.threadStarter.run();
+			testInfo.rates = results.rates;
+			testInfo.nets = results.nets;
+			testInfo.sched = results.sched;
 			if (results.failed > 0)
 				testInfo.status = ULightTestStatus::Failed;
 			else if (results.incomplete > 0)
@@ -179,6 +374,11 @@ static void RunTestFn(ULightTestStage stage, ULightTestInfo& testInfo, bool runS
 			{
 				testInfo.testFn();
 				testInfo.status = ULightTestStatus::Passed;
+				if (ThreadCheckFailures() > 0)
+				{
+					testInfo.status = ULightTestStatus::Failed;
+					testInfo.error = ThreadCheckError(testInfo.filename, testInfo.lineNumber);
+				}
 			}
 			else if (testInfo.threadStarter.has_tasks())
 			{
@@ -214,14 +414,50 @@ static void RunTestFn(ULightTestStage stage, ULightTestInfo& testInfo, bool runS
     }
 }
 
-static void RunTest(ULightTestInfo& testInfo, bool runStressTests)
+// Phases, CHECKs, RANDOM seeds and the trace are shared by the whole process
+// and belong to the main harness.  A harness run from inside one of its tests
+// (e.g. to benchmark the reports) must leave them alone, or it would wipe the
+// state of the test that is running it.
+static void RunTest(ULightTestInfo& testInfo, bool runStressTests, int64_t sampleIntervalMs, bool ownsTestState)
 {
     //std::wcout << L"Running " << testInfo.testName << std::endl;
 
+	ULightTestTimer timer;
+	if (ownsTestState)
+	{
+		g_traceTest.store(g_traceEnabled.load() ? TraceName(testInfo.testName) : 0);
+		ResetRandom(testInfo.testName);
+		ResetChecks();
+	}
 	RunTestFn(ULightTestStage::Setup, testInfo, runStressTests);
+
+	// Only long running tests are worth sampling COUNT counters for
+	bool sampled = (testInfo.stressTest && runStressTests) || testInfo.threadStarter.has_tasks();
+	ULightCounterSampler sampler;
+	if (sampled)
+		sampler.Start(sampleIntervalMs);
+	if (ownsTestState)
+		ResetPhases();
 	RunTestFn(ULightTestStage::Task, testInfo, runStressTests);
 	RunTestFn(ULightTestStage::Run, testInfo, runStressTests);
+	if (ownsTestState)
+	{
+		testInfo.phases = CollectPhases();
+		testInfo.checks = CollectChecks();
+	}
+	if (!testInfo.checks.empty() && testInfo.status == ULightTestStatus::Passed)
+	{
+		// CHECKs that failed outside the test function, e.g. in SETUP
+		testInfo.status = ULightTestStatus::Failed;
+		testInfo.error = testInfo.checks[0].message;
+		testInfo.filename = testInfo.checks[0].filename;
+		testInfo.lineNumber = testInfo.checks[0].lineNumber;
+	}
+	if (sampled)
+		testInfo.counters = sampler.Stop();
+
 	RunTestFn(ULightTestStage::Teardown, testInfo, runStressTests);
+	testInfo.elapsed = timer.Poll();
 }
 
 ULightTestInfo *ULightTests::GetCurrentTestInfo()
@@ -235,11 +471,12 @@ void ULightTests::Init(int argc, char **argv, std::wostream& ostr)
 	std::vector<std::string> args;
 	std::copy(argv + 1, argv + argc, std::back_inserter(args));
 
-	for(auto& s : args)
+	for(size_t i = 0; i < args.size(); ++i)
 	{
 		std::wstringstream str;
-		str << s.c_str();
+		str << args[i].c_str();
 		std::wstring arg = str.str();
+		bool hasValue = i + 1 < args.size();
 
 		if (arg == L"-b" || arg == L"--benchmark")
 			m_benchmarks = true;
@@ -249,32 +486,247 @@ void ULightTests::Init(int argc, char **argv, std::wostream& ostr)
 			m_runStressTests = true;
 		else if (arg == L"-r" || arg == L"--reports")
 			m_reports = true;
+		else if (arg == L"-p" || arg == L"--pin")
+			m_pinThread = true;
+		else if (arg.compare(0, 6, L"--pin=") == 0)
+			m_pinThread = true, m_pinCpu = (int)std::wcstol(arg.c_str() + 6, nullptr, 10);
+		else if (arg == L"--status" && hasValue)
+			m_statusFile = args[++i];
+		else if (arg == L"--sample-interval" && hasValue)
+			m_sampleIntervalMs = std::max(std::atol(args[++i].c_str()), 1L);
+		else if (arg == L"--shard")
+		{
+			// K/N with K counting from 1.  Running the wrong split silently
+			// would skip or repeat tests, so a bad value stops the run.
+			unsigned long k = 0, n = 0;
+			int length = 0;
+			const char *value = hasValue ? args[++i].c_str() : "";
+			if (std::strchr(value, '-') != nullptr || std::sscanf(value, "%lu/%lu%n", &k, &n, &length) != 2 || value[length] != '\0' || k < 1 || k > n)
+			{
+				*outStream << L"Invalid --shard \"" << value << L"\", expected K/N with 1 <= K <= N" << std::endl;
+				std::exit(2);
+			}
+			m_shardIndex = k - 1, m_shardCount = n;
+		}
+		else if (arg == L"--list")
+			m_listTests = true;
+		else if (arg == L"--results" && hasValue)
+			m_resultsFile = args[++i];
+		else if (arg == L"--history" && hasValue)
+			m_historyFile = args[++i];
+		else if (arg == L"--merge")
+			m_merge = true;
+		else if (arg == L"--seed" && hasValue)
+			SetRandomSeed(std::strtoull(args[++i].c_str(), nullptr, 0));
+		else if (arg == L"--trace" && hasValue)
+			m_traceFile = args[++i];
+		else if (arg == L"--trace-events" && hasValue)
+			m_traceEvents = std::max(std::atol(args[++i].c_str()), 1L);
 		else if (arg.length() > 0 && arg[0] != L'-')
+		{
 			m_namedTests.push_back(arg);
+			m_mergeFiles.push_back(args[i]);
+		}
+	}
+}
+
+static uint64_t HashTestName(const std::wstring& name)
+{
+	// FNV-1a, so every shard computes the same split regardless of compiler
+	uint64_t hash = 14695981039346656037ULL;
+	for (wchar_t c : name)
+	{
+		hash ^= (uint64_t)c;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+void ULightTests::SelectShard()
+{
+	std::map<std::wstring, int64_t> history;
+	if (!m_historyFile.empty())
+	{
+		std::vector<ULightTestRecord> records;
+		int64_t elapsed = 0;
+		if (ReadResultsFile(m_historyFile, records, elapsed))
+		{
+			for (auto& record : records)
+				history[record.testName] = record.elapsedUs;
+		}
+	}
+
+	// Tests with a known duration are dealt longest first to the least loaded
+	// shard; the rest are split by name hash
+	std::vector<ULightTestInfo *> timed;
+	for (auto& testInfo : m_tests)
+	{
+		if (testInfo->ignore)
+			continue;
+		if (history.count(testInfo->testName) > 0)
+			timed.push_back(testInfo);
+		else if (HashTestName(testInfo->testName) % m_shardCount != m_shardIndex)
+			testInfo->ignore = true;
+	}
+	std::sort(timed.begin(), timed.end(), [&](ULightTestInfo *a, ULightTestInfo *b)
+	{
+		int64_t ta = history[a->testName], tb = history[b->testName];
+		return ta != tb ? ta > tb : a->testName < b->testName;
+	});
+	std::vector<int64_t> load(m_shardCount, 0);
+	for (auto testInfo : timed)
+	{
+		size_t shard = std::min_element(load.begin(), load.end()) - load.begin();
+		load[shard] += history[testInfo->testName];
+		if (shard != m_shardIndex)
+			testInfo->ignore = true;
+	}
+}
+
+void ULightTests::MergeResults()
+{
+	for (auto& testInfo : m_tests)
+		testInfo->ignore = true;
+
+	for (auto& path : m_mergeFiles)
+	{
+		std::vector<ULightTestRecord> records;
+		int64_t elapsed = 0;
+		if (!ReadResultsFile(path, records, elapsed))
+		{
+			// A lost shard must not look like a smaller green run
+			*outStream << L"Could not read results file " << path.c_str() << std::endl;
+			std::exit(2);
+		}
+		// Shards run side by side, so wall time is the slowest shard
+		m_elapsedTime = std::max(m_elapsedTime, elapsed);
+		for (auto& record : records)
+		{
+			ULightTestInfo *testInfo = FindOrCreateTestInfo(m_tests, record.testName);
+			testInfo->ignore = false;
+			testInfo->status = (ULightTestStatus)record.status;
+			testInfo->elapsed = record.elapsedUs;
+			testInfo->benchmarked = record.benchmarked;
+			testInfo->benchmarktime = record.benchmarktime;
+			testInfo->itemsPerSecond = record.itemsPerSecond;
+			testInfo->filename = record.filename;
+			testInfo->lineNumber = record.lineNumber;
+			testInfo->error = record.error;
+			testInfo->compared = record.compared;
+			testInfo->comparison = record.comparison;
+			testInfo->sweep = record.sweep;
+			testInfo->counters = record.counters;
+			testInfo->phases = record.phases;
+			testInfo->rates = record.rates;
+			testInfo->nets = record.nets;
+			testInfo->sched = record.sched;
+			testInfo->checks = record.checks;
+		}
 	}
 }
 
 void ULightTests::Execute()
 {
-	ULightTestTimer timer;
+	if (m_merge)
+	{
+		MergeResults();
+		return;
+	}
+
 	bool namedOnly = m_namedTests.size() > 0;
+	size_t toRun = 0;
+	for(auto& testInfo : m_tests)
+	{
+		if (namedOnly && std::find(m_namedTests.begin(), m_namedTests.end(), testInfo->testName) == m_namedTests.end())
+			testInfo->ignore = true;
+	}
+	if (m_shardCount > 0)
+		SelectShard();
+	for(auto& testInfo : m_tests)
+	{
+		if (!testInfo->ignore)
+			++toRun;
+	}
+
+	if (m_listTests)
+	{
+		for(auto& testInfo : m_tests)
+		{
+			if (!testInfo->ignore)
+				DirectToStream(testInfo->testName + (testInfo->stressTest ? L" (stress)" : L""));
+		}
+		return;
+	}
+
+	if (m_benchmarks)
+	{
+		m_environment = CollectEnvironment();
+		Calibrate();
+		SetSchedStatsEnabled(true);
+	}
+	if (m_pinThread)
+		PinBenchmarkThread(m_pinCpu, m_environment);
+
+	if (!m_statusFile.empty() && !StatusOpen(m_statusFile))
+	{
+		std::wstringstream str;
+		str << L"Warning: could not create status file " << m_statusFile.c_str();
+		DirectToStream(str.str());
+	}
+	// Only touch the status file if this harness opened it
+	bool status = !m_statusFile.empty();
+	if (status)
+		StatusSetTotal(toRun);
+	if (!m_traceFile.empty())
+		TraceStart(m_traceEvents);
+
+	bool ownsTestState = this == &GetTestHarness();
+	ULightTestTimer timer;
+	size_t passed = 0, failed = 0, skipped = 0, incomplete = 0;
     for(auto& testInfo : m_tests)
     {
+		if (testInfo->ignore)
+			continue;
 		m_currentTest = testInfo;
-		if (namedOnly)
-		{
-			if (std::find(m_namedTests.begin(), m_namedTests.end(), testInfo->testName) != m_namedTests.end())
-				RunTest(*testInfo, m_runStressTests);
-			else
-				testInfo->ignore = true;
-		}
+		if (status)
+			StatusTestBegin(testInfo->testName);
+        RunTest(*testInfo, m_runStressTests, m_sampleIntervalMs, ownsTestState);
+		if (testInfo->status == ULightTestStatus::Passed)
+			++passed;
+		else if (testInfo->status == ULightTestStatus::Skipped)
+			++skipped;
+		else if (testInfo->status == ULightTestStatus::Incomplete)
+			++incomplete;
 		else
-		{
-        	RunTest(*testInfo, m_runStressTests);
-		}
+			++failed;
+		if (status)
+			StatusTestEnd(passed, failed, skipped, incomplete, timer.Poll());
         m_currentTest = nullptr;
     }
 	m_elapsedTime = timer.Poll();
+	if (status)
+		StatusClose();
+
+	uint64_t dropped = 0;
+	if (!m_traceFile.empty() && !TraceWrite(m_traceFile, dropped))
+	{
+		std::wstringstream str;
+		str << L"Warning: could not write trace file " << m_traceFile.c_str();
+		DirectToStream(str.str());
+	}
+	else if (dropped > 0)
+	{
+		std::wstringstream str;
+		str << L"Warning: " << dropped << L" trace events did not fit; raise --trace-events";
+		DirectToStream(str.str());
+	}
+
+	if (!m_resultsFile.empty() && !WriteResultsFile(m_resultsFile, m_tests, m_elapsedTime))
+	{
+		std::wstringstream str;
+		str << L"Warning: could not write results file " << m_resultsFile.c_str();
+		DirectToStream(str.str());
+	}
 }
 
 void ULightTests::ReportBack(const std::wstring& msg)
@@ -287,7 +739,7 @@ void ULightTests::ReportBack(const std::wstring& msg)
 
 void ULightTests::ReportToStream()
 {
-	if (outStream == nullptr)
+	if (outStream == nullptr || m_listTests)
 		return;
 	std::wostream& os(*outStream);
 	int total = 0;
@@ -314,10 +766,36 @@ void ULightTests::ReportToStream()
 
 	if (m_benchmarks)
 	{
+		if (!m_merge)
+		{
+			ReportEnvironment(os, m_environment);
+			const ULightCalibration& calibration = GetCalibration();
+			os << L"Harness:" << std::endl
+				<< L" Timer        " << calibration.timerNs << L"ns" << std::endl
+				<< L" Dispatch     " << calibration.dispatchNs << L"ns" << std::endl
+				<< L" Noise floor  " << calibration.noiseFloorNs << L"ns" << std::endl
+				<< L" Seed         " << GetRandomSeed() << std::endl
+				<< std::endl;
+		}
 		for (auto& testInfo : m_tests)
 		{
 			if (testInfo->ignore)
 				continue;
+			if (testInfo->compared)
+			{
+				const ULightCompareResult& cmp = testInfo->comparison;
+				std::wstringstream str;
+				str << std::fixed << std::setprecision(2)
+					<< cmp.speedup << L"x [" << cmp.speedupLow << L"x, " << cmp.speedupHigh << L"x]";
+				os << std::setw(26) << str.str() << L" ";
+				if (!cmp.Significant())
+					os << L"no significant difference ";
+				else if (cmp.speedup > 1.0)
+					os << L"candidate faster ";
+				else
+					os << L"candidate slower ";
+				os << testInfo->testName << std::endl;
+			}
 			if (testInfo->benchmarked)
 			{
 				os << std::setw(8) << MakeNumberPrettyNumber(testInfo->benchmarktime) << L"us ";
@@ -325,12 +803,34 @@ void ULightTests::ReportToStream()
 					os << std::setw(12) << MakeNumberPrettyNumber(testInfo->itemsPerSecond) << L"/s ";
 				else
 					os << std::setw(12) << L"" << L"   ";
-				os << testInfo->testName << std::endl;
+				os << testInfo->testName;
+				// Below 100x the noise floor the harness is more than 1% of the number
+				if (!m_merge && testInfo->sweep.empty() && testInfo->benchmarkNs < GetCalibration().noiseFloorNs * 100)
+					os << L" (near harness noise floor)";
+				os << std::endl;
+				ReportSweep(os, testInfo->sweep);
+				ReportPhases(os, testInfo->phases);
 			}
+			ReportCounters(os, testInfo->testName, testInfo->counters);
+			ReportRates(os, testInfo->testName, testInfo->rates);
+			ReportNets(os, testInfo->testName, testInfo->nets);
+			ReportSched(os, testInfo->testName, testInfo->sched);
 		}
 		os << std::endl;
 	}
 
+	for (auto& testInfo : m_tests)
+	{
+		if (testInfo->ignore)
+			continue;
+		for (auto& timeline : testInfo->counters)
+		{
+			if (timeline.collapsed)
+				os << L"Warning: " << timeline.name << L" throughput collapsed at "
+					<< MakeNumberPrettyNumber(timeline.collapseMs) << L"ms in " << testInfo->testName << std::endl << std::endl;
+		}
+	}
+
 	if (m_reports && m_reportsBack.size() > 0)
 	{
 		for (auto &rep : m_reportsBack)
@@ -364,7 +864,16 @@ void ULightTests::ReportToStream()
 		{
 			os << L"Test Failed: " << testInfo->testName << std::endl
 				<< L" Location: " << testInfo->filename << L" (" << testInfo->lineNumber << L")" << std::endl
-				<< L" Error: " << testInfo->error << std::endl << std::endl;
+				<< L" Error: " << testInfo->error << std::endl;
+			for (auto& check : testInfo->checks)
+			{
+				if (check.lineNumber > 0)
+					os << L" Check: " << check.filename << L" (" << check.lineNumber << L") " << MakeNumberPrettyNumber(check.count)
+						<< L" times in " << check.threads << L" threads: " << check.message << std::endl;
+				else
+					os << L" Check: " << MakeNumberPrettyNumber(check.count) << L" " << check.message << std::endl;
+			}
+			os << std::endl;
 		}
 	}
 
@@ -379,6 +888,13 @@ void ULightTests::ReportToStream()
 		<< std::endl;
 }
 
+void ULightTests::CompareInCurrentTest(std::function<void()> baseline, std::function<void()> candidate, const ULightCompareOptions& options)
+{
+	ULightTestInfo *testInfo = GetCurrentTestInfo();
+	testInfo->comparison = Compare(baseline, candidate, options);
+	testInfo->compared = true;
+}
+
 void ULightTests::DirectToStream(const std::wstring& msg)
 {
 	if (outStream != nullptr)
@@ -19,6 +19,17 @@
 
 #include "ULightTestTimer.h"
 #include "ULightCppThreadStarter.h"
+#include "ULightCompare.h"
+#include "ULightEnvironment.h"
+#include "ULightCache.h"
+#include "ULightStatusFile.h"
+#include "ULightCounters.h"
+#include "ULightPhases.h"
+#include "ULightTrace.h"
+#include "ULightDataFile.h"
+#include "ULightRandom.h"
+#include "ULightCheck.h"
+#include "ULightResultsFile.h"
 
 #include <initializer_list>
 #include <iostream>
@@ -38,7 +49,7 @@ struct ULightTestInfo
 {
 	ULightTestInfo(std::wstring testName_, std::function<void()> testFn_, bool stressTest_)
 	 :	testName(testName_), testFn(testFn_),
-		status(ULightTestStatus::Inconclusive), error(L""), filename(L""), lineNumber(0), ignore(false), stressTest(stressTest_), benchmarked(false), benchmarktime(0), itemsPerSecond(0)
+		status(ULightTestStatus::Inconclusive), error(L""), filename(L""), lineNumber(0), ignore(false), stressTest(stressTest_), benchmarked(false), benchmarktime(0), itemsPerSecond(0), benchmarkNs(0), elapsed(0), compared(false)
 		{}
 
     std::wstring testName;
@@ -56,6 +67,17 @@ struct ULightTestInfo
     bool benchmarked;
     int64_t benchmarktime;
 	int64_t itemsPerSecond;
+	int64_t benchmarkNs;
+	int64_t elapsed;
+	bool compared;
+	ULightCompareResult comparison;
+	std::vector<ULightSweepPoint> sweep;
+	std::vector<ULightCounterTimeline> counters;
+	std::vector<ULightPhaseStat> phases;
+	std::vector<ULightRateResults> rates;
+	std::vector<ULightNetResults> nets;
+	std::vector<ULightTaskSched> sched;
+	std::vector<ULightCheckResult> checks;
 };
 
 class ULightTests
@@ -66,7 +88,9 @@ class ULightTests
 
 		void AddTestSetup(std::wstring testName_, std::function<void()> testFn_);
 		void AddTestTeardown(std::wstring testName_, std::function<void()> testFn_);
-		void AddTask(std::wstring testName_, std::function<void()> testFn_, size_t count);
+		void AddTask(std::wstring testName_, std::function<void()> testFn_, size_t count, std::wstring taskName_ = std::wstring());
+		void AddNetTask(std::wstring testName_, std::wstring taskName_, std::function<ULightNetClients()> clientsFn_);
+		void AddRateTask(std::wstring testName_, std::wstring taskName_, std::function<void()> testFn_, size_t count, double startRate, double endRate, int64_t durationMs);
 		void AddTest(std::wstring testName_, std::function<void()> testFn_, bool stressTest_);
 
 		void Init(int argc, char **argv, std::wostream& ostr);
@@ -77,9 +101,14 @@ class ULightTests
 
 		void DirectToStream(const std::wstring& msg);
 
+		void CompareInCurrentTest(std::function<void()> baseline, std::function<void()> candidate, const ULightCompareOptions& options);
+
         ULightTestInfo *GetCurrentTestInfo();
     protected:
     private:
+		void SelectShard();
+		void MergeResults();
+
 		std::wostream *outStream;
         std::vector<ULightTestInfo *> m_tests;
         std::vector<std::wstring> m_namedTests;
@@ -89,6 +118,20 @@ class ULightTests
 		bool m_reports;
         bool m_verbose;
 		bool m_runStressTests;
+		bool m_pinThread;
+		int m_pinCpu;
+		ULightEnvironmentInfo m_environment;
+		std::string m_statusFile;
+		int64_t m_sampleIntervalMs;
+		size_t m_shardIndex;
+		size_t m_shardCount;
+		bool m_listTests;
+		bool m_merge;
+		std::string m_resultsFile;
+		std::string m_historyFile;
+		std::vector<std::string> m_mergeFiles;
+		std::string m_traceFile;
+		size_t m_traceEvents;
         ULightTestInfo *m_currentTest;
 };
 
@@ -97,12 +140,12 @@ enum ULightTestStage { Setup, Run, Teardown, Task };
 class UnitTest
 {
 public:
-    UnitTest(ULightTests& unitTests, std::function<void()> test, const std::wstring& testName, bool stressTest, ULightTestStage stage, size_t count)
+    UnitTest(ULightTests& unitTests, std::function<void()> test, const std::wstring& testName, bool stressTest, ULightTestStage stage, size_t count, const std::wstring& taskName = std::wstring())
     {
 		if (stage == ULightTestStage::Setup)
 			unitTests.AddTestSetup(testName, test);
 		else if (stage == ULightTestStage::Task)
-			unitTests.AddTask( testName, test, count);
+			unitTests.AddTask( testName, test, count, taskName);
 		else if (stage == ULightTestStage::Run)
 			unitTests.AddTest( testName, test, stressTest );
 		else if (stage == ULightTestStage::Teardown)
@@ -110,6 +153,24 @@ public:
     }
 };
 
+class UnitTestRateTask
+{
+public:
+    UnitTestRateTask(ULightTests& unitTests, std::function<void()> test, const std::wstring& testName, const std::wstring& taskName, size_t count, double startRate, double endRate, int64_t durationMs)
+    {
+		unitTests.AddRateTask(testName, taskName, test, count, startRate, endRate, durationMs);
+    }
+};
+
+class UnitTestNetTask
+{
+public:
+    UnitTestNetTask(ULightTests& unitTests, std::function<ULightNetClients()> clients, const std::wstring& testName, const std::wstring& taskName)
+    {
+		unitTests.AddNetTask(testName, taskName, clients);
+    }
+};
+
 class UnitTestException
 {
 public:
@@ -152,6 +213,9 @@ int main(int argc, char **argv)\
 #define UNITTEST_WIDEN2(x) L ## x
 #define UNITTEST_WIDEN(x) UNITTEST_WIDEN2(x)
 
+#define UNITTEST_CONCAT2(a, b) a ## b
+#define UNITTEST_CONCAT(a, b) UNITTEST_CONCAT2(a, b)
+
 #define UNITTESTFILE \
     extern ULightCpp::ULightTests unitTests;
 
@@ -172,14 +236,69 @@ int main(int argc, char **argv)\
 
 #define TEST_TASK(testName, subName, count) \
     static void Test##testName##task##subName(); \
-    static ULightCpp::UnitTest impl_##testName##task##subName(ULightCpp::GetTestHarness(), Test##testName##task##subName, UNITTEST_WIDEN(#testName), false, ULightCpp::ULightTestStage::Task, count); \
+    static ULightCpp::UnitTest impl_##testName##task##subName(ULightCpp::GetTestHarness(), Test##testName##task##subName, UNITTEST_WIDEN(#testName), false, ULightCpp::ULightTestStage::Task, count, UNITTEST_WIDEN(#subName)); \
     static void Test##testName##task##subName()
 
+#define TEST_TASK_RAMP(testName, subName, count, startRate, endRate, durationMs) \
+    static void Test##testName##task##subName(); \
+    static ULightCpp::UnitTestRateTask impl_##testName##task##subName(ULightCpp::GetTestHarness(), Test##testName##task##subName, UNITTEST_WIDEN(#testName), UNITTEST_WIDEN(#subName), count, startRate, endRate, durationMs); \
+    static void Test##testName##task##subName()
+
+#define TEST_TASK_RATE(testName, subName, count, rate, durationMs) \
+    TEST_TASK_RAMP(testName, subName, count, rate, rate, durationMs)
+
+#define NET_TASK(testName, subName) \
+    static ULightCpp::ULightNetClients Test##testName##net##subName(); \
+    static ULightCpp::UnitTestNetTask impl_##testName##net##subName(ULightCpp::GetTestHarness(), Test##testName##net##subName, UNITTEST_WIDEN(#testName), UNITTEST_WIDEN(#subName)); \
+    static ULightCpp::ULightNetClients Test##testName##net##subName()
+
 #define STRESSTEST(testName) \
     static void Test##testName(); \
     static ULightCpp::UnitTest impl_##testName(ULightCpp::GetTestHarness(), Test##testName, UNITTEST_WIDEN(#testName), true, ULightCpp::ULightTestStage::Run, 0); \
     static void Test##testName()
 
+#define BENCHMARK_COMPARE(testName, baselineFn, candidateFn) \
+    static void Test##testName() { ULightCpp::GetTestHarness().CompareInCurrentTest(baselineFn, candidateFn, ULightCpp::ULightCompareOptions()); } \
+    static ULightCpp::UnitTest impl_##testName(ULightCpp::GetTestHarness(), Test##testName, UNITTEST_WIDEN(#testName), false, ULightCpp::ULightTestStage::Run, 0)
+
+#define BENCHMARK_COLD(testName, iterations) \
+    static void Test##testName(); \
+    static void Test##testName##_Cold() { ULightCpp::RunCold(Test##testName, iterations); } \
+    static ULightCpp::UnitTest impl_##testName(ULightCpp::GetTestHarness(), Test##testName##_Cold, UNITTEST_WIDEN(#testName), false, ULightCpp::ULightTestStage::Run, 0); \
+    static void Test##testName()
+
+#define BENCHMARK_SWEEP(testName) \
+    static void Test##testName(char *buffer, size_t bytes); \
+    static void Test##testName##_Sweep() { ULightCpp::RunSweep(Test##testName); } \
+    static ULightCpp::UnitTest impl_##testName(ULightCpp::GetTestHarness(), Test##testName##_Sweep, UNITTEST_WIDEN(#testName), false, ULightCpp::ULightTestStage::Run, 0); \
+    static void Test##testName(char *buffer, size_t bytes)
+
+// The buffer is flushed before every timed run of the BENCHMARK_COLD body, so
+// it must outlive the benchmark; don't register one allocated in the body
+#define EVICT_BUFFER(buffer, size) ULightCpp::RegisterEvictBuffer(buffer, size);
+
+#define DATAFILE(path) ULightCpp::OpenDataFile(path, ULightCpp::ULightDataFileOptions(), UNITTEST_WIDEN(__FILE__), __LINE__)
+
+#define DATAFILE_OPTIONS(path, options) ULightCpp::OpenDataFile(path, options, UNITTEST_WIDEN(__FILE__), __LINE__)
+
+#define RANDOM ULightCpp::TestRandom()
+
+#define PROGRESS(count) ULightCpp::StatusProgress(count);
+
+#define COUNT(name, count) \
+{ \
+	static const size_t counter_dee5e24c44b011e38782089e0125ab67 = ULightCpp::CounterId(UNITTEST_WIDEN(name), UNITTEST_WIDEN(__FILE__), __LINE__); \
+	ULightCpp::CounterAdd(counter_dee5e24c44b011e38782089e0125ab67, count); \
+}
+
+#define PHASE(name) \
+	static const size_t UNITTEST_CONCAT(phaseid_dee5e24c44b011e38782089e0125ab67_, __LINE__) = ULightCpp::PhaseId(UNITTEST_WIDEN(name)); \
+	ULightCpp::ULightPhase UNITTEST_CONCAT(phase_dee5e24c44b011e38782089e0125ab67_, __LINE__)(UNITTEST_CONCAT(phaseid_dee5e24c44b011e38782089e0125ab67_, __LINE__));
+
+#define TRACE_SPAN(name) \
+	static const uint32_t UNITTEST_CONCAT(traceid_dee5e24c44b011e38782089e0125ab67_, __LINE__) = ULightCpp::TraceName(UNITTEST_WIDEN(name)); \
+	ULightCpp::ULightTraceSpan UNITTEST_CONCAT(trace_dee5e24c44b011e38782089e0125ab67_, __LINE__)(ULightCpp::ULightTraceCategory::Span, UNITTEST_CONCAT(traceid_dee5e24c44b011e38782089e0125ab67_, __LINE__), 0);
+
 #define SKIPTEST throw ULightCpp::UnitTestSkipException();
 
 #define INCOMPLETE throw ULightCpp::UnitTestIncompleteException();
@@ -194,6 +313,21 @@ int main(int argc, char **argv)\
 	} \
 }
 
+#define CHECK(pred, msg) \
+{ \
+	if (!(pred)) \
+	{ \
+		static const ULightCpp::ULightCheckSite site_dee5e24c44b011e38782089e0125ab67 = { UNITTEST_WIDEN(__FILE__), __LINE__ }; \
+		ULightCpp::ULightCheckSlot *slot_dee5e24c44b011e38782089e0125ab67 = ULightCpp::CheckFailed(&site_dee5e24c44b011e38782089e0125ab67); \
+		if (slot_dee5e24c44b011e38782089e0125ab67 != nullptr) \
+		{ \
+			std::wstringstream str_dee5e24c44b011e38782089e0125ab67; \
+			str_dee5e24c44b011e38782089e0125ab67 << msg; \
+			slot_dee5e24c44b011e38782089e0125ab67->message = str_dee5e24c44b011e38782089e0125ab67.str(); \
+		} \
+	} \
+}
+
 #define REPORT(msg) \
 { \
 	std::wstringstream str_dee5e24c44b011e38782089e0125ab67; \
@@ -216,7 +350,7 @@ int main(int argc, char **argv)\
 		{ Code; } \
 		good = false; \
 	} \
-	catch(ExType ex) \
+	catch(const ExType& ex) \
 	{ \
 		good = true; \
 	} \
@@ -227,6 +361,25 @@ int main(int argc, char **argv)\
 	T(good, msg); \
 }
 
+#define CHECK_EXCEPTION(ExType, Code, msg) \
+{ \
+	bool good = false; \
+	try \
+	{ \
+		{ Code; } \
+		good = false; \
+	} \
+	catch(const ExType& ex) \
+	{ \
+		good = true; \
+	} \
+	catch(...) \
+	{ \
+		good = false; \
+	} \
+	CHECK(good, msg); \
+}
+
 #define BENCHMARK ULightCpp::ULightTestTimer timer_dee5e24c44b011e38782089e0125ab67(&ULightCpp::GetTestHarness(), 0);
 
 #define BENCHIPS(ItemsPerSecond) ULightCpp::ULightTestTimer timer_dee5e24c44b011e38782089e0125ab67(&ULightCpp::GetTestHarness(), ItemsPerSecond);
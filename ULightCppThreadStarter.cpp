@@ -16,7 +16,13 @@
 
 #include "ULightCppThreadStarter.h"
 #include "ULightCpp.h"
+#include "ULightEnvironment.h"
+#include "ULightStatusFile.h"
+#include "ULightTrace.h"
+#include "ULightRandom.h"
+#include "ULightCheck.h"
 
+#include <algorithm>
 #include <thread>
 
 namespace ULightCpp
@@ -67,6 +73,12 @@ std::vector<std::pair<std::wstring, size_t>> ULightTestThreadInfo::get_errors()
 	return std::move(ret);
 }
 
+std::vector<ULightTaskSched> ULightTestThreadInfo::get_sched()
+{
+	std::lock_guard<std::mutex> lck { m_mutex };
+	return m_sched;
+}
+
 void ULightTestThreadInfo::set_passed()
 {
 	std::lock_guard<std::mutex> lck { m_mutex };
@@ -101,9 +113,58 @@ void ULightTestThreadInfo::set_failed(const std::wstring& error)
 		m_errors[error] += 1;
 }
 
+void ULightTestThreadInfo::add_task(const std::wstring& task, bool paced)
+{
+	std::lock_guard<std::mutex> lck { m_mutex };
+
+	auto it = std::find_if(m_sched.begin(), m_sched.end(), [&](const ULightTaskSched& sched) { return sched.name == task; });
+	if (it == m_sched.end())
+	{
+		m_sched.push_back(ULightTaskSched());
+		m_sched.back().name = task;
+		m_sched.back().paced = paced;
+	}
+}
+
+void ULightTestThreadInfo::add_sched(const std::wstring& task, const ULightSchedSample& sample)
+{
+	std::lock_guard<std::mutex> lck { m_mutex };
+
+	auto it = std::find_if(m_sched.begin(), m_sched.end(), [&](const ULightTaskSched& sched) { return sched.name == task; });
+	if (it != m_sched.end())
+		it->Add(sample);
+}
+
+
+// Names the thread after its test and returns the name of its lifetime span
+static uint32_t trace_thread(const std::wstring& name)
+{
+	if (!g_traceEnabled.load(std::memory_order_relaxed))
+		return 0;
+	TraceThreadName(g_traceTest.load(std::memory_order_relaxed));
+	return TraceName(name);
+}
+
+// A thread that recorded CHECK failures but did not otherwise fail counts
+// as failed with its first CHECK message
+static void set_check_failures(ULightTestThreadInfo* info, bool failed)
+{
+	if (failed || ThreadCheckFailures() == 0)
+		return;
+	std::wstring filename;
+	int lineNumber = 0;
+	info->set_failed(ThreadCheckError(filename, lineNumber));
+}
 
-static void thread_proc(std::function<void()> func, ULightTestThreadInfo* info)
+static void thread_proc(std::function<void()> func, size_t index, std::wstring name, ULightTestThreadInfo* info)
 {
+	bool sched = SchedStatsEnabled();
+	ULightSchedSample start = sched ? SampleThreadSched() : ULightSchedSample();
+	UnpinTaskThread();
+	StatusThreadBegin();
+	SetRandomStream(index + 1);
+	ULightTraceSpan span(ULightTraceCategory::Task, trace_thread(name.empty() ? L"task" : name), g_traceTest.load(std::memory_order_relaxed));
+	bool failed = false;
 	try
 	{
 		func();
@@ -111,6 +172,7 @@ static void thread_proc(std::function<void()> func, ULightTestThreadInfo* info)
     catch(UnitTestException ex)
     {
 		info->set_failed(ex.error);
+		failed = true;
     }
 	catch(UnitTestSkipException skipEx)
 	{
@@ -123,30 +185,107 @@ static void thread_proc(std::function<void()> func, ULightTestThreadInfo* info)
     catch(...)
     {
 		info->set_failed(L"Unexpected exception");
+		failed = true;
     }
+	set_check_failures(info, failed);
+	StatusThreadEnd();
+	if (sched)
+		info->add_sched(name, SchedDelta(start, SampleThreadSched()));
 }
 
-void ULightTestThreadStarter::add(std::function<void()> func, size_t count)
+static void net_thread_proc(std::shared_ptr<ULightNetDriver> netDriver, size_t thread, size_t stream, ULightTestThreadInfo* info)
+{
+	bool sched = SchedStatsEnabled();
+	ULightSchedSample start = sched ? SampleThreadSched() : ULightSchedSample();
+	UnpinTaskThread();
+	StatusThreadBegin();
+	SetRandomStream(stream);
+	ULightTraceSpan span(ULightTraceCategory::Task, trace_thread(netDriver->Name()), g_traceTest.load(std::memory_order_relaxed));
+	try
+	{
+		netDriver->RunThread(thread, info);
+	}
+	catch(...)
+	{
+		info->set_failed(L"Unexpected exception");
+	}
+	set_check_failures(info, false);
+	StatusThreadEnd();
+	if (sched)
+		info->add_sched(netDriver->Name(), SchedDelta(start, SampleThreadSched()));
+}
+
+void ULightTestThreadStarter::add(std::function<void()> func, size_t count, const std::wstring& name)
 {
 	for(size_t i = 0; i < count; ++i)
 	{
 		m_tasks.push_back(func);
+		m_taskNames.push_back(name);
 	}
 }
 
+void ULightTestThreadStarter::add_rate(std::shared_ptr<ULightOpenLoop> openLoop, size_t count)
+{
+	m_openLoops.push_back(openLoop);
+	add([openLoop]() { openLoop->Run(); }, count, openLoop->Name());
+}
+
+void ULightTestThreadStarter::add_net(std::shared_ptr<ULightNetDriver> netDriver)
+{
+	m_netDrivers.push_back(netDriver);
+}
+
 ULightRunResults ULightTestThreadStarter::run()
 {
 	ULightTestThreadInfo info;
 	
-	for(auto& task : m_tasks)
+	// Declared up front so the report lists tasks in the order they were added
+	if (SchedStatsEnabled())
 	{
-		m_threads.push_back(std::move(std::thread(thread_proc, task, &info)));
+		for(auto& name : m_taskNames)
+		{
+			bool openLoop = std::any_of(m_openLoops.begin(), m_openLoops.end(), [&](const std::shared_ptr<ULightOpenLoop>& openLoop) { return openLoop->Name() == name; });
+			info.add_task(name, openLoop);
+		}
+		for(auto& netDriver : m_netDrivers)
+		{
+			info.add_task(netDriver->Name(), true);
+		}
 	}
-	for(auto& thread : m_threads)
+	// Runs the NET_TASK bodies before any thread starts, so nothing is left
+	// running against info if one of them throws
+	std::vector<size_t> netThreads;
+	for(auto& netDriver : m_netDrivers)
 	{
-		thread.join();
+		netThreads.push_back(netDriver->Prepare());
 	}
-	m_threads.clear();
+	for(auto& openLoop : m_openLoops)
+	{
+		openLoop->Begin();
+	}
+	try
+	{
+		for(size_t i = 0; i < m_tasks.size(); ++i)
+		{
+			m_threads.push_back(std::move(std::thread(thread_proc, m_tasks[i], i, m_taskNames[i], &info)));
+		}
+		// Net threads take the RANDOM streams after the task threads'
+		size_t stream = m_tasks.size() + 1;
+		for(size_t d = 0; d < m_netDrivers.size(); ++d)
+		{
+			for(size_t i = 0; i < netThreads[d]; ++i)
+			{
+				m_threads.push_back(std::thread(net_thread_proc, m_netDrivers[d], i, stream++, &info));
+			}
+		}
+	}
+	catch(...)
+	{
+		// Could not start a thread; the ones already running still use info
+		join();
+		throw;
+	}
+	join();
 	
 	ULightRunResults results;
 	results.passed = info.get_passed();
@@ -154,13 +293,31 @@ ULightRunResults ULightTestThreadStarter::run()
 	results.skipped = info.get_skipped();
 	results.incomplete = info.get_incomplete();
 	results.errors = std::move(info.get_errors());
+	results.sched = info.get_sched();
+	for(auto& openLoop : m_openLoops)
+	{
+		results.rates.push_back(openLoop->Results());
+	}
+	for(auto& netDriver : m_netDrivers)
+	{
+		results.nets.push_back(netDriver->Results());
+	}
 	
 	return results;
 }
 
+void ULightTestThreadStarter::join()
+{
+	for(auto& thread : m_threads)
+	{
+		thread.join();
+	}
+	m_threads.clear();
+}
+
 bool ULightTestThreadStarter::has_tasks()
 {
-	return m_tasks.size() > 0;
+	return m_tasks.size() > 0 || m_netDrivers.size() > 0;
 }
 
 } // namespace ULightCpp
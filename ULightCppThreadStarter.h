@@ -24,6 +24,11 @@
 #include <thread>
 #include <mutex>
 #include <map>
+#include <memory>
+
+#include "ULightOpenLoop.h"
+#include "ULightNetDriver.h"
+#include "ULightSchedStats.h"
 
 namespace ULightCpp
 {
@@ -35,6 +40,9 @@ struct ULightRunResults
 	size_t skipped;
 	size_t incomplete;
 	std::vector<std::pair<std::wstring, size_t>> errors;
+	std::vector<ULightRateResults> rates;
+	std::vector<ULightNetResults> nets;
+	std::vector<ULightTaskSched> sched;
 };
 
 class ULightTestThreadInfo
@@ -45,6 +53,7 @@ class ULightTestThreadInfo
 	size_t m_skipped;
 	size_t m_incomplete;
 	std::map<std::wstring, size_t> m_errors;
+	std::vector<ULightTaskSched> m_sched;
 public:
 	ULightTestThreadInfo();
 	~ULightTestThreadInfo();
@@ -55,19 +64,29 @@ public:
 	size_t get_incomplete();
 	
 	std::vector<std::pair<std::wstring, size_t>> get_errors();
+	std::vector<ULightTaskSched> get_sched();
 	
 	void set_passed();
 	void set_incomplete();
 	void set_skipped();
 	void set_failed(const std::wstring& error);
+	void add_task(const std::wstring& task, bool paced);
+	void add_sched(const std::wstring& task, const ULightSchedSample& sample);
 };
 
 class ULightTestThreadStarter
 {
 	std::vector<std::function<void()>> m_tasks;
+	std::vector<std::wstring> m_taskNames;
 	std::vector<std::thread> m_threads;
+	std::vector<std::shared_ptr<ULightOpenLoop>> m_openLoops;
+	std::vector<std::shared_ptr<ULightNetDriver>> m_netDrivers;
+
+	void join();
 public:
-	void add(std::function<void()> func, size_t count);
+	void add(std::function<void()> func, size_t count, const std::wstring& name = std::wstring());
+	void add_rate(std::shared_ptr<ULightOpenLoop> openLoop, size_t count);
+	void add_net(std::shared_ptr<ULightNetDriver> netDriver);
 	ULightRunResults run();
 	
 	bool has_tasks();
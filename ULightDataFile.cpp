@@ -0,0 +1,234 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightDataFile.h"
+#include "ULightCpp.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ULightCpp
+{
+
+static const size_t HugePageSize = 2 * 1024 * 1024;
+
+struct DataFileEntry
+{
+	std::shared_ptr<const ULightDataFile> file;
+	bool populated;
+};
+
+static std::mutex s_dataFileMutex;
+static std::map<std::string, DataFileEntry> s_dataFiles;
+static volatile char s_touchSink;
+
+static std::wstring Widen(const std::string& s)
+{
+	std::wstringstream str;
+	str << s.c_str();
+	return str.str();
+}
+
+ULightDataFile::ULightDataFile(const std::string& path, void *mapping, size_t mappingSize, const char *data, size_t size, bool hugePages)
+ :	m_path(path), m_mapping(mapping), m_mappingSize(mappingSize), m_data(data), m_size(size), m_hugePages(hugePages)
+{
+}
+
+ULightDataFile::~ULightDataFile()
+{
+	if (m_mapping != nullptr)
+		munmap(m_mapping, m_mappingSize);
+}
+
+void ULightDataFile::Fail(const std::string& path, const char *reason, size_t offset, size_t size, size_t element)
+{
+	std::wstringstream str;
+	str << Widen(path) << L": " << reason << L" (" << size - std::min(offset, size) << L" bytes from offset " << offset
+		<< L", records of " << element << L" bytes)";
+	throw UnitTestException(str.str(), L"", 0);
+}
+
+// Reads one byte from every page so none of them fault later
+static void TouchPages(const char *data, size_t size)
+{
+	long pageSize = sysconf(_SC_PAGESIZE);
+	char sum = 0;
+	for (size_t offset = 0; offset < size; offset += pageSize)
+		sum += data[offset];
+	s_touchSink = sum;
+}
+
+// madvise(MADV_HUGEPAGE) succeeds even when transparent huge pages are
+// turned off, so check the setting before paying for the copy
+static bool HugePagesEnabled()
+{
+	std::ifstream in("/sys/kernel/mm/transparent_hugepage/enabled");
+	std::string line;
+	if (!std::getline(in, line))
+		return false;
+	return line.find("[always]") != std::string::npos || line.find("[madvise]") != std::string::npos;
+}
+
+// Size in kB of the huge pages backing the mapping that contains address, or
+// -1 if /proc/self/smaps can't be read
+static int64_t AnonHugePagesKb(const void *address)
+{
+	std::ifstream in("/proc/self/smaps");
+	if (!in)
+		return -1;
+	bool inMapping = false;
+	std::string line;
+	while (std::getline(in, line))
+	{
+		unsigned long start, end;
+		if (std::sscanf(line.c_str(), "%lx-%lx ", &start, &end) == 2 && line.find(':') > line.find(' '))
+			inMapping = start <= (uintptr_t)address && (uintptr_t)address < end;
+		else if (inMapping && line.compare(0, 14, "AnonHugePages:") == 0)
+			return std::atol(line.c_str() + 14);
+	}
+	return -1;
+}
+
+// An anonymous copy of the file aligned for transparent huge pages.  Returns
+// nullptr if huge pages are not available, so the caller maps the file.
+static void *CopyToHugePages(int fd, size_t size, size_t& mappingSize)
+{
+#ifdef MADV_HUGEPAGE
+	static const bool enabled = HugePagesEnabled();
+	if (!enabled)
+		return nullptr;
+	mappingSize = (size + HugePageSize - 1) / HugePageSize * HugePageSize;
+	void *mapping = mmap(nullptr, mappingSize + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+		return nullptr;
+
+	// Trim to a huge page boundary at both ends
+	char *base = (char *)mapping;
+	char *aligned = (char *)(((uintptr_t)base + HugePageSize - 1) / HugePageSize * HugePageSize);
+	if (aligned != base)
+		munmap(base, aligned - base);
+	munmap(aligned + mappingSize, base + HugePageSize - aligned);
+
+	if (madvise(aligned, mappingSize, MADV_HUGEPAGE) != 0)
+	{
+		munmap(aligned, mappingSize);
+		return nullptr;
+	}
+	size_t done = 0;
+	while (done < size)
+	{
+		ssize_t n = pread(fd, aligned + done, size - done, done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+		{
+			munmap(aligned, mappingSize);
+			return nullptr;
+		}
+		done += n;
+	}
+	mprotect(aligned, mappingSize, PROT_READ);
+
+	// Without free huge pages the kernel quietly uses small ones, and then
+	// the copy only costs memory
+	if (AnonHugePagesKb(aligned) == 0)
+	{
+		munmap(aligned, mappingSize);
+		return nullptr;
+	}
+	return aligned;
+#else
+	return nullptr;
+#endif
+}
+
+static std::shared_ptr<const ULightDataFile> MapDataFile(const std::string& path, const ULightDataFileOptions& options, const std::wstring& filename, int lineNumber)
+{
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw UnitTestException(L"Could not open data file " + Widen(path) + L": " + Widen(std::strerror(errno)), filename, lineNumber);
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		int error = errno;
+		close(fd);
+		throw UnitTestException(L"Could not stat data file " + Widen(path) + L": " + Widen(std::strerror(error)), filename, lineNumber);
+	}
+	size_t size = (size_t)st.st_size;
+	if (size == 0)
+	{
+		close(fd);
+		return std::make_shared<ULightDataFile>(path, nullptr, 0, "", 0, false);
+	}
+
+	if (options.hugePages)
+	{
+		size_t mappingSize = 0;
+		void *mapping = CopyToHugePages(fd, size, mappingSize);
+		if (mapping != nullptr)
+		{
+			close(fd);
+			return std::make_shared<ULightDataFile>(path, mapping, mappingSize, (const char *)mapping, size, true);
+		}
+	}
+
+	int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+	if (options.prefault == ULightPrefault::Populate)
+		flags |= MAP_POPULATE;
+#endif
+	void *mapping = mmap(nullptr, size, PROT_READ, flags, fd, 0);
+	int error = errno;
+	close(fd);
+	if (mapping == MAP_FAILED)
+		throw UnitTestException(L"Could not map data file " + Widen(path) + L": " + Widen(std::strerror(error)), filename, lineNumber);
+	return std::make_shared<ULightDataFile>(path, mapping, size, (const char *)mapping, size, false);
+}
+
+std::shared_ptr<const ULightDataFile> OpenDataFile(const std::string& path, const ULightDataFileOptions& options, const std::wstring& filename, int lineNumber)
+{
+	std::lock_guard<std::mutex> lck { s_dataFileMutex };
+	auto it = s_dataFiles.find(path);
+	if (it == s_dataFiles.end())
+	{
+		auto mapped = MapDataFile(path, options, filename, lineNumber);
+		it = s_dataFiles.emplace(path, DataFileEntry { mapped, mapped->HugePages() }).first;
+	}
+
+	// Touching each page covers platforms without MAP_POPULATE and files
+	// first opened without prefaulting
+	const ULightDataFile& file = *it->second.file;
+	if (options.prefault == ULightPrefault::Populate && !it->second.populated)
+	{
+		TouchPages(file.Data(), file.Size());
+		it->second.populated = true;
+	}
+	else if (options.prefault == ULightPrefault::WillNeed && !it->second.populated && file.Size() > 0)
+		madvise((void *)file.Data(), file.Size(), MADV_WILLNEED);
+	return it->second.file;
+}
+
+}
@@ -0,0 +1,176 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightDataFile__
+#define __ULightCpp__ULightDataFile__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+namespace ULightCpp
+{
+
+enum class ULightPrefault
+{
+	None,		// Pages fault in as they are first read
+	Populate,	// Fault every page in before DATAFILE returns
+	WillNeed	// Start reading the file in the background and return straight away
+};
+
+struct ULightDataFileOptions
+{
+	ULightDataFileOptions()
+	 :	prefault(ULightPrefault::Populate), hugePages(false)
+		{}
+
+	ULightPrefault prefault;
+	bool hugePages;		// Copy into transparent huge pages rather than map the file
+};
+
+// A read only run of T inside a data file
+template<typename T>
+class ULightSpan
+{
+	const T *m_data;
+	size_t m_size;
+public:
+	ULightSpan() : m_data(nullptr), m_size(0) {}
+	ULightSpan(const T *data, size_t size) : m_data(data), m_size(size) {}
+
+	const T *data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	const T *begin() const { return m_data; }
+	const T *end() const { return m_data + m_size; }
+	const T& operator[](size_t i) const { return m_data[i]; }
+
+	ULightSpan<T> subspan(size_t offset, size_t count) const
+	{
+		offset = offset < m_size ? offset : m_size;
+		return ULightSpan<T>(m_data + offset, count < m_size - offset ? count : m_size - offset);
+	}
+};
+
+// One delimited record, without its delimiter
+struct ULightRecord
+{
+	const char *data;
+	size_t size;
+
+	std::string str() const { return std::string(data, size); }
+};
+
+class ULightRecordIterator
+{
+	const char *m_next;
+	const char *m_end;
+	char m_delimiter;
+	ULightRecord m_record;
+
+	void Advance()
+	{
+		if (m_next == m_end)
+		{
+			m_record.data = nullptr;
+			return;
+		}
+		const char *found = (const char *)std::memchr(m_next, m_delimiter, m_end - m_next);
+		const char *recordEnd = found != nullptr ? found : m_end;
+		m_record.data = m_next;
+		m_record.size = recordEnd - m_next;
+		m_next = found != nullptr ? found + 1 : m_end;
+	}
+public:
+	ULightRecordIterator() : m_next(nullptr), m_end(nullptr), m_delimiter(0), m_record { nullptr, 0 } {}
+	ULightRecordIterator(const char *begin, const char *end, char delimiter)
+	 :	m_next(begin), m_end(end), m_delimiter(delimiter), m_record { nullptr, 0 }
+	{
+		Advance();
+	}
+
+	const ULightRecord& operator*() const { return m_record; }
+	const ULightRecord *operator->() const { return &m_record; }
+	ULightRecordIterator& operator++() { Advance(); return *this; }
+	bool operator==(const ULightRecordIterator& other) const { return m_record.data == other.m_record.data; }
+	bool operator!=(const ULightRecordIterator& other) const { return m_record.data != other.m_record.data; }
+};
+
+// Records separated by a delimiter, such as the lines of a text file.  A
+// trailing delimiter does not add an empty record.
+class ULightRecords
+{
+	const char *m_begin;
+	const char *m_end;
+	char m_delimiter;
+public:
+	ULightRecords(const char *begin, const char *end, char delimiter) : m_begin(begin), m_end(end), m_delimiter(delimiter) {}
+
+	ULightRecordIterator begin() const { return ULightRecordIterator(m_begin, m_end, m_delimiter); }
+	ULightRecordIterator end() const { return ULightRecordIterator(); }
+};
+
+// A file mapped read only for the rest of the run
+class ULightDataFile
+{
+	std::string m_path;
+	void *m_mapping;
+	size_t m_mappingSize;
+	const char *m_data;
+	size_t m_size;
+	bool m_hugePages;
+
+	static void Fail(const std::string& path, const char *reason, size_t offset, size_t size, size_t element);
+public:
+	ULightDataFile(const std::string& path, void *mapping, size_t mappingSize, const char *data, size_t size, bool hugePages);
+	~ULightDataFile();
+
+	ULightDataFile(const ULightDataFile&) = delete;
+	ULightDataFile& operator=(const ULightDataFile&) = delete;
+
+	const std::string& Path() const { return m_path; }
+	const char *Data() const { return m_data; }
+	size_t Size() const { return m_size; }
+	bool HugePages() const { return m_hugePages; }
+
+	ULightSpan<char> Bytes() const { return ULightSpan<char>(m_data, m_size); }
+
+	ULightRecords Records(char delimiter = '\n') const { return ULightRecords(m_data, m_data + m_size, delimiter); }
+
+	// The file from offset on as an array of fixed size records.  Fails the
+	// test if the records would be misaligned or the size is not a whole
+	// number of records.
+	template<typename T>
+	ULightSpan<T> As(size_t offset = 0) const
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "records must be trivially copyable");
+		if (offset > m_size || (m_size - offset) % sizeof(T) != 0 || (uintptr_t)(m_data + offset) % alignof(T) != 0)
+			Fail(m_path, "not a whole number of aligned records", offset, m_size, sizeof(T));
+		return ULightSpan<T>((const T *)(m_data + offset), (m_size - offset) / sizeof(T));
+	}
+};
+
+// Opening the same path again returns the same mapping, so tests and task
+// threads can share one copy of a large corpus.  Failures are reported as a
+// test failure at filename and lineNumber.
+std::shared_ptr<const ULightDataFile> OpenDataFile(const std::string& path, const ULightDataFileOptions& options, const std::wstring& filename, int lineNumber);
+
+}
+
+#endif // __ULightCpp__ULightDataFile__
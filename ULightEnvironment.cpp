@@ -0,0 +1,276 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightEnvironment.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <sys/utsname.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef __MACH__
+#include <sys/sysctl.h>
+#endif
+
+namespace ULightCpp
+{
+
+static std::wstring Widen(const std::string& s)
+{
+	std::wstringstream str;
+	str << s.c_str();
+	return str.str();
+}
+
+static std::string Trim(const std::string& s)
+{
+	size_t begin = s.find_first_not_of(" \t\r\n");
+	if (begin == std::string::npos)
+		return "";
+	size_t end = s.find_last_not_of(" \t\r\n");
+	return s.substr(begin, end - begin + 1);
+}
+
+static std::string ReadFirstLine(const char *path)
+{
+	std::ifstream in(path);
+	std::string line;
+	if (in)
+		std::getline(in, line);
+	return Trim(line);
+}
+
+static std::wstring CpuModel()
+{
+#ifdef __MACH__
+	char brand[256];
+	size_t len = sizeof(brand);
+	if (sysctlbyname("machdep.cpu.brand_string", brand, &len, nullptr, 0) == 0)
+		return Widen(brand);
+#endif
+	std::ifstream in("/proc/cpuinfo");
+	std::string line;
+	while (std::getline(in, line))
+	{
+		size_t colon = line.find(':');
+		if (colon == std::string::npos)
+			continue;
+		std::string key = Trim(line.substr(0, colon));
+		if (key == "model name" || key == "Hardware" || key == "Model")
+			return Widen(Trim(line.substr(colon + 1)));
+	}
+	return L"unknown";
+}
+
+#ifdef __linux__
+static std::vector<int> ParseCpuList(const std::string& list)
+{
+	// Kernel cpu list format, e.g. "0-3,8,10-11"
+	std::vector<int> cpus;
+	std::stringstream str(list);
+	std::string range;
+	while (std::getline(str, range, ','))
+	{
+		range = Trim(range);
+		if (range.empty())
+			continue;
+		size_t dash = range.find('-');
+		int first = std::atoi(range.substr(0, dash).c_str());
+		int last = dash == std::string::npos ? first : std::atoi(range.substr(dash + 1).c_str());
+		for (int cpu = first; cpu <= last; ++cpu)
+			cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+static pid_t CurrentThreadId()
+{
+	return (pid_t)syscall(SYS_gettid);
+}
+
+static bool s_pinned = false;
+static cpu_set_t s_originalAffinity;
+static int s_originalNice = 0;
+#endif
+
+ULightEnvironmentInfo CollectEnvironment()
+{
+	ULightEnvironmentInfo info;
+	info.cpuModel = CpuModel();
+
+	struct utsname uts;
+	if (uname(&uts) == 0)
+		info.kernel = Widen(std::string(uts.sysname) + " " + uts.release + " " + uts.machine);
+
+	info.governor = Widen(ReadFirstLine("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor"));
+
+	std::string noTurbo = ReadFirstLine("/sys/devices/system/cpu/intel_pstate/no_turbo");
+	std::string boost = ReadFirstLine("/sys/devices/system/cpu/cpufreq/boost");
+	if (!noTurbo.empty())
+		info.turbo = noTurbo == "1" ? L"disabled" : L"enabled";
+	else if (!boost.empty())
+		info.turbo = boost == "1" ? L"enabled" : L"disabled";
+
+	std::string smt = ReadFirstLine("/sys/devices/system/cpu/smt/active");
+	if (!smt.empty())
+		info.smt = smt == "1" ? L"on" : L"off";
+
+	if (getloadavg(info.loadAverage, 3) != 3)
+		info.loadAverage[0] = info.loadAverage[1] = info.loadAverage[2] = -1;
+
+	info.onlineCpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	return info;
+}
+
+void PinBenchmarkThread(int cpu, ULightEnvironmentInfo& info)
+{
+#ifdef __linux__
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+	{
+		info.pinNote = L"could not read cpu affinity";
+		return;
+	}
+	s_originalAffinity = allowed;
+	s_originalNice = getpriority(PRIO_PROCESS, CurrentThreadId());
+
+	if (cpu < 0)
+	{
+		for (int isolated : ParseCpuList(ReadFirstLine("/sys/devices/system/cpu/isolated")))
+		{
+			if (CPU_ISSET(isolated, &allowed))
+			{
+				cpu = isolated;
+				break;
+			}
+		}
+		// No isolated cpu; take the highest numbered one as it is least
+		// likely to be servicing interrupts
+		for (int c = CPU_SETSIZE - 1; cpu < 0 && c >= 0; --c)
+		{
+			if (CPU_ISSET(c, &allowed))
+				cpu = c;
+		}
+	}
+
+	cpu_set_t pinned;
+	CPU_ZERO(&pinned);
+	if (cpu < 0 || cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed))
+	{
+		info.pinNote = L"cpu not available to this process";
+	}
+	else
+	{
+		CPU_SET(cpu, &pinned);
+		if (sched_setaffinity(0, sizeof(pinned), &pinned) == 0)
+		{
+			info.pinnedCpu = cpu;
+			s_pinned = true;
+		}
+		else
+		{
+			info.pinNote = L"cpu pinning not permitted";
+		}
+	}
+
+	if (setpriority(PRIO_PROCESS, CurrentThreadId(), -20) == 0)
+	{
+		info.priorityRaised = true;
+		s_pinned = true;
+	}
+	else
+	{
+		info.pinNote += info.pinNote.empty() ? L"" : L", ";
+		info.pinNote += L"priority change not permitted";
+	}
+#else
+	(void)cpu;
+	info.pinNote = L"pinning not supported on this platform";
+#endif
+}
+
+void UnpinTaskThread()
+{
+#ifdef __linux__
+	if (!s_pinned)
+		return;
+	sched_setaffinity(0, sizeof(s_originalAffinity), &s_originalAffinity);
+	setpriority(PRIO_PROCESS, CurrentThreadId(), s_originalNice);
+#endif
+}
+
+std::vector<std::wstring> EnvironmentWarnings(const ULightEnvironmentInfo& info)
+{
+	std::vector<std::wstring> warnings;
+	if (!info.governor.empty() && info.governor != L"performance")
+		warnings.push_back(L"cpu governor is '" + info.governor + L"', clock speed may vary between runs");
+	if (info.turbo == L"enabled")
+		warnings.push_back(L"turbo boost is enabled, results depend on thermal headroom");
+	if (info.smt == L"on" && info.pinnedCpu >= 0)
+		warnings.push_back(L"SMT is on, the pinned cpu shares a core with its sibling");
+	if (info.loadAverage[0] > 1.0)
+	{
+		std::wstringstream str;
+		str << L"load average is " << std::fixed << std::setprecision(2) << info.loadAverage[0]
+			<< L", other processes are competing for cpu time";
+		warnings.push_back(str.str());
+	}
+	return warnings;
+}
+
+void ReportEnvironment(std::wostream& os, const ULightEnvironmentInfo& info)
+{
+	std::wstringstream load;
+	load << std::fixed << std::setprecision(2)
+		<< info.loadAverage[0] << L" " << info.loadAverage[1] << L" " << info.loadAverage[2];
+
+	os << L"Environment:" << std::endl
+		<< L" CPU          " << info.cpuModel << L" (" << info.onlineCpus << L" online)" << std::endl
+		<< L" Kernel       " << info.kernel << std::endl
+		<< L" Governor     " << (info.governor.empty() ? L"unknown" : info.governor) << std::endl
+		<< L" Turbo        " << (info.turbo.empty() ? L"unknown" : info.turbo) << std::endl
+		<< L" SMT          " << (info.smt.empty() ? L"unknown" : info.smt) << std::endl
+		<< L" Load         " << (info.loadAverage[0] < 0 ? L"unknown" : load.str()) << std::endl;
+
+	if (info.pinnedCpu >= 0 || info.priorityRaised || !info.pinNote.empty())
+	{
+		os << L" Pinned       ";
+		if (info.pinnedCpu >= 0)
+			os << L"cpu " << info.pinnedCpu;
+		else
+			os << L"no";
+		if (info.priorityRaised)
+			os << L", priority raised";
+		if (!info.pinNote.empty())
+			os << L" (" << info.pinNote << L")";
+		os << std::endl;
+	}
+
+	for (auto& warning : EnvironmentWarnings(info))
+		os << L"Warning: " << warning << std::endl;
+	os << std::endl;
+}
+
+}
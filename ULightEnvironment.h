@@ -0,0 +1,64 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightEnvironment__
+#define __ULightCpp__ULightEnvironment__
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace ULightCpp
+{
+
+struct ULightEnvironmentInfo
+{
+	ULightEnvironmentInfo()
+	 :	onlineCpus(0), pinnedCpu(-1), priorityRaised(false)
+		{ loadAverage[0] = loadAverage[1] = loadAverage[2] = -1; }
+
+	std::wstring cpuModel;
+	std::wstring kernel;
+	std::wstring governor;	// Empty if unknown
+	std::wstring turbo;		// "enabled", "disabled" or empty if unknown
+	std::wstring smt;		// "on", "off" or empty if unknown
+	double loadAverage[3];
+	int onlineCpus;
+
+	int pinnedCpu;			// -1 if the benchmark thread was not pinned
+	bool priorityRaised;
+	std::wstring pinNote;	// Why pinning or priority changes fell back
+};
+
+ULightEnvironmentInfo CollectEnvironment();
+
+// Pins the calling thread to cpu, or to an isolated cpu (falling back to the
+// last cpu we may run on) when cpu is negative, and tries to raise its
+// priority.  Failures are recorded in info.pinNote rather than reported as
+// errors so the run carries on unpinned.
+void PinBenchmarkThread(int cpu, ULightEnvironmentInfo& info);
+
+// Task threads inherit the pinned affinity and priority of the thread that
+// started them; this gives them back the original process settings.
+void UnpinTaskThread();
+
+std::vector<std::wstring> EnvironmentWarnings(const ULightEnvironmentInfo& info);
+
+void ReportEnvironment(std::wostream& os, const ULightEnvironmentInfo& info);
+
+}
+
+#endif // __ULightCpp__ULightEnvironment__
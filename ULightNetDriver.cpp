@@ -0,0 +1,440 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightNetDriver.h"
+#include "ULightCpp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace ULightCpp
+{
+
+static int64_t NowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static std::wstring Widen(const std::string& s)
+{
+	std::wstringstream str;
+	str << s.c_str();
+	return str.str();
+}
+
+ULightNetDriver::ULightNetDriver(const std::wstring& name, std::function<ULightNetClients()> factory)
+ :	m_name(name), m_factory(factory), m_setup(ULightNetSetup::Ready), m_family(0), m_sockType(0), m_requests(0), m_failed(0), m_startNs(0), m_endNs(0)
+{
+}
+
+#ifdef __linux__
+
+size_t ULightNetDriver::Prepare()
+{
+	m_setup = ULightNetSetup::Ready;
+	m_setupError.clear();
+	m_latenciesNs.clear();
+	m_requests = 0;
+	m_failed = 0;
+	try
+	{
+		m_clients = m_factory();
+	}
+	catch(UnitTestException ex)
+	{
+		m_setupError = ex.error;
+		return 1;
+	}
+	catch(UnitTestSkipException)
+	{
+		m_setup = ULightNetSetup::Skipped;
+		return 1;
+	}
+	catch(UnitTestIncompleteException)
+	{
+		m_setup = ULightNetSetup::Incomplete;
+		return 1;
+	}
+	catch(...)
+	{
+		m_setupError = L"Unexpected exception";
+		return 1;
+	}
+	if (!m_clients.request || !m_clients.response)
+	{
+		m_setupError = L"NET_TASK needs both request and response callbacks";
+		return 1;
+	}
+
+	if (m_clients.protocol == ULightNetProtocol::Unix)
+	{
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (m_clients.path.size() >= sizeof(addr.sun_path))
+		{
+			m_setupError = L"unix socket path is too long";
+			return 1;
+		}
+		std::strcpy(addr.sun_path, m_clients.path.c_str());
+		m_address.assign((char *)&addr, (char *)&addr + sizeof(addr));
+		m_family = AF_UNIX;
+		m_sockType = SOCK_STREAM;
+	}
+	else
+	{
+		addrinfo hints;
+		std::memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = m_clients.protocol == ULightNetProtocol::Udp ? SOCK_DGRAM : SOCK_STREAM;
+		addrinfo *found = nullptr;
+		std::string port = std::to_string(m_clients.port);
+		int rc = getaddrinfo(m_clients.host.c_str(), port.c_str(), &hints, &found);
+		if (rc != 0 || found == nullptr)
+		{
+			m_setupError = L"could not resolve " + Widen(m_clients.host) + L": " + Widen(gai_strerror(rc));
+			return 1;
+		}
+		m_address.assign((char *)found->ai_addr, (char *)found->ai_addr + found->ai_addrlen);
+		m_family = found->ai_family;
+		m_sockType = found->ai_socktype;
+		freeaddrinfo(found);
+	}
+
+	// Thousands of connections need more descriptors than the usual soft limit
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+	{
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit(RLIMIT_NOFILE, &limit);
+	}
+
+	m_startNs = NowNs();
+	m_endNs = m_startNs;
+	return std::max<size_t>(std::min(m_clients.threads, m_clients.connections), 1);
+}
+
+namespace
+{
+
+enum class ConnState { Connecting, Sending, Receiving, Done };
+
+struct Connection
+{
+	size_t index;
+	int fd;
+	ConnState state;
+	size_t request;
+	std::string out;
+	size_t sent;
+	std::string in;
+	int64_t startNs;
+	int64_t deadlineNs;
+};
+
+}
+
+void ULightNetDriver::RunThread(size_t thread, ULightTestThreadInfo *info)
+{
+	const ULightNetClients& clients = m_clients;
+	size_t threads = std::max<size_t>(std::min(clients.threads, clients.connections), 1);
+
+	if (!ReportSetup(thread, info))
+		return;
+
+	const int64_t timeoutNs = clients.timeoutMs * 1000000;
+	std::vector<int64_t> latencies;
+	uint64_t requests = 0;
+	size_t failed = 0;
+	size_t open = 0;
+
+	int epfd = epoll_create1(0);
+	if (epfd < 0)
+	{
+		info->set_failed(L"epoll_create1 failed");
+		return;
+	}
+
+	std::vector<Connection> conns;
+	for (size_t c = thread; c < clients.connections; c += threads)
+		conns.push_back(Connection { c, -1, ConnState::Connecting, 0, std::string(), 0, std::string(), 0, 0 });
+
+	auto fail = [&](Connection& conn, const std::wstring& error)
+	{
+		if (conn.fd >= 0)
+			close(conn.fd);
+		conn.fd = -1;
+		conn.state = ConnState::Done;
+		--open;
+		++failed;
+		info->set_failed(error);
+	};
+
+	auto finish = [&](Connection& conn)
+	{
+		close(conn.fd);
+		conn.fd = -1;
+		conn.state = ConnState::Done;
+		--open;
+		info->set_passed();
+	};
+
+	auto watch = [&](Connection& conn, uint32_t events)
+	{
+		epoll_event ev;
+		ev.events = events;
+		ev.data.u64 = &conn - conns.data();
+		epoll_ctl(epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+	};
+
+	// Returns false if the connection failed
+	auto flush = [&](Connection& conn) -> bool
+	{
+		while (conn.sent < conn.out.size())
+		{
+			ssize_t n = send(conn.fd, conn.out.data() + conn.sent, conn.out.size() - conn.sent, MSG_NOSIGNAL);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			{
+				watch(conn, EPOLLOUT);
+				conn.state = ConnState::Sending;
+				return true;
+			}
+			if (n < 0)
+			{
+				fail(conn, L"send failed: " + Widen(std::strerror(errno)));
+				return false;
+			}
+			conn.sent += n;
+		}
+		conn.state = ConnState::Receiving;
+		watch(conn, EPOLLIN);
+		return true;
+	};
+
+	auto startRequest = [&](Connection& conn)
+	{
+		try
+		{
+			conn.out = clients.request(conn.index, conn.request);
+		}
+		catch(UnitTestException ex)
+		{
+			fail(conn, ex.error);
+			return;
+		}
+		catch(...)
+		{
+			// Anything else would leave the other connections open
+			fail(conn, L"Unexpected exception");
+			return;
+		}
+		conn.sent = 0;
+		conn.in.clear();
+		conn.startNs = NowNs();
+		conn.deadlineNs = conn.startNs + timeoutNs;
+		flush(conn);
+	};
+
+	auto receive = [&](Connection& conn)
+	{
+		char buffer[16384];
+		for (;;)
+		{
+			ssize_t n = recv(conn.fd, buffer, sizeof(buffer), 0);
+			if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return;
+			if (n < 0)
+			{
+				fail(conn, L"recv failed: " + Widen(std::strerror(errno)));
+				return;
+			}
+			if (n == 0 && m_sockType == SOCK_STREAM)
+			{
+				fail(conn, L"connection closed by server");
+				return;
+			}
+			conn.in.append(buffer, n);
+
+			ULightNetReply reply;
+			try
+			{
+				reply = clients.response(conn.index, conn.in);
+			}
+			catch(UnitTestException ex)
+			{
+				fail(conn, ex.error);
+				return;
+			}
+			catch(...)
+			{
+				fail(conn, L"Unexpected exception");
+				return;
+			}
+			if (reply == ULightNetReply::Failed)
+			{
+				fail(conn, L"response rejected");
+				return;
+			}
+			if (reply == ULightNetReply::Complete)
+			{
+				latencies.push_back(NowNs() - conn.startNs);
+				++requests;
+				if (++conn.request == clients.requestsPerConnection)
+					finish(conn);
+				else
+					startRequest(conn);
+				return;
+			}
+		}
+	};
+
+	for (auto& conn : conns)
+	{
+		conn.fd = socket(m_family, m_sockType | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		++open;
+		if (conn.fd < 0)
+		{
+			fail(conn, L"socket failed: " + Widen(std::strerror(errno)));
+			continue;
+		}
+		if (m_clients.protocol == ULightNetProtocol::Tcp)
+		{
+			int one = 1;
+			setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		}
+		epoll_event ev;
+		ev.events = EPOLLOUT;
+		ev.data.u64 = &conn - conns.data();
+		epoll_ctl(epfd, EPOLL_CTL_ADD, conn.fd, &ev);
+		conn.startNs = NowNs();
+		conn.deadlineNs = conn.startNs + timeoutNs;
+		int rc = connect(conn.fd, (const sockaddr *)m_address.data(), (socklen_t)m_address.size());
+		if (rc != 0 && errno != EINPROGRESS)
+			fail(conn, L"connect failed: " + Widen(std::strerror(errno)));
+	}
+
+	std::vector<epoll_event> events(256);
+	int64_t nextTimeoutScan = NowNs();
+	while (open > 0)
+	{
+		int n = epoll_wait(epfd, events.data(), (int)events.size(), 100);
+		for (int i = 0; i < n; ++i)
+		{
+			Connection& conn = conns[events[i].data.u64];
+			if (conn.state == ConnState::Done)
+				continue;
+			if (conn.state == ConnState::Connecting)
+			{
+				int error = 0;
+				socklen_t len = sizeof(error);
+				getsockopt(conn.fd, SOL_SOCKET, SO_ERROR, &error, &len);
+				if (error != 0)
+					fail(conn, L"connect failed: " + Widen(std::strerror(error)));
+				else
+					startRequest(conn);
+			}
+			else if (conn.state == ConnState::Sending)
+				flush(conn);
+			else if (conn.state == ConnState::Receiving)
+				receive(conn);
+		}
+
+		// Scanning every connection is cheap at this rate even with thousands
+		int64_t now = NowNs();
+		if (now < nextTimeoutScan)
+			continue;
+		nextTimeoutScan = now + 50000000;
+		for (auto& conn : conns)
+		{
+			if (conn.state != ConnState::Done && now > conn.deadlineNs)
+				fail(conn, conn.state == ConnState::Connecting ? L"connect timed out" : L"request timed out");
+		}
+	}
+	close(epfd);
+
+	std::lock_guard<std::mutex> lck { m_mutex };
+	m_latenciesNs.insert(m_latenciesNs.end(), latencies.begin(), latencies.end());
+	m_requests += requests;
+	m_failed += failed;
+	m_endNs = std::max(m_endNs, NowNs());
+}
+
+#else
+
+size_t ULightNetDriver::Prepare()
+{
+	m_setupError = L"NET_TASK needs epoll and is only supported on Linux";
+	return 1;
+}
+
+void ULightNetDriver::RunThread(size_t thread, ULightTestThreadInfo *info)
+{
+	ReportSetup(thread, info);
+}
+
+#endif
+
+bool ULightNetDriver::ReportSetup(size_t thread, ULightTestThreadInfo *info)
+{
+	if (m_setup == ULightNetSetup::Ready && m_setupError.empty())
+		return true;
+	if (thread != 0)
+		return false;
+	if (m_setup == ULightNetSetup::Skipped)
+		info->set_skipped();
+	else if (m_setup == ULightNetSetup::Incomplete)
+		info->set_incomplete();
+	else
+		info->set_failed(m_setupError);
+	return false;
+}
+
+ULightNetResults ULightNetDriver::Results()
+{
+	std::lock_guard<std::mutex> lck { m_mutex };
+	std::sort(m_latenciesNs.begin(), m_latenciesNs.end());
+
+	ULightNetResults results;
+	results.name = m_name;
+	results.connections = m_clients.connections;
+	results.failedConnections = m_setupError.empty() ? m_failed : m_clients.connections;
+	results.requests = m_requests;
+	results.elapsedUs = (m_endNs - m_startNs) / 1000;
+	if (!m_latenciesNs.empty())
+	{
+		results.p50Us = m_latenciesNs[m_latenciesNs.size() / 2] / 1000.0;
+		results.p99Us = m_latenciesNs[std::min(m_latenciesNs.size() - 1, m_latenciesNs.size() * 99 / 100)] / 1000.0;
+		results.maxUs = m_latenciesNs.back() / 1000.0;
+	}
+	return results;
+}
+
+}
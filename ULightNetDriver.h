@@ -0,0 +1,120 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightNetDriver__
+#define __ULightCpp__ULightNetDriver__
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ULightCpp
+{
+
+class ULightTestThreadInfo;
+
+enum class ULightNetProtocol { Tcp, Udp, Unix };
+
+enum class ULightNetReply { NeedMore, Complete, Failed };
+
+// Describes a set of client connections for a NET_TASK
+struct ULightNetClients
+{
+	ULightNetClients()
+	 :	protocol(ULightNetProtocol::Tcp), host("127.0.0.1"), port(0), connections(1), threads(1),
+		requestsPerConnection(1), timeoutMs(5000)
+		{}
+
+	ULightNetProtocol protocol;
+	std::string host;				// Tcp and Udp
+	uint16_t port;
+	std::string path;				// Unix socket path
+	size_t connections;
+	size_t threads;					// Event loop threads the connections are spread over
+	size_t requestsPerConnection;
+	int64_t timeoutMs;				// Per request, including connecting
+
+	// Bytes to send for request number 'request' on 'connection'
+	std::function<std::string(size_t connection, size_t request)> request;
+
+	// Called with everything received since the request was sent.  Return
+	// NeedMore until the whole response has arrived.
+	std::function<ULightNetReply(size_t connection, const std::string& received)> response;
+};
+
+struct ULightNetResults
+{
+	ULightNetResults()
+	 :	connections(0), failedConnections(0), requests(0), elapsedUs(0), p50Us(0), p99Us(0), maxUs(0)
+		{}
+
+	std::wstring name;
+	size_t connections;
+	size_t failedConnections;
+	uint64_t requests;			// Completed requests
+	int64_t elapsedUs;
+	double p50Us;
+	double p99Us;
+	double maxUs;
+};
+
+// How the NET_TASK body ended when it was asked for the client description.
+// Failures are kept as the error message instead.
+enum class ULightNetSetup { Ready, Skipped, Incomplete };
+
+// Runs many non-blocking client connections from a few epoll threads.  Each
+// connection counts as one passed or failed task in ULightTestThreadInfo.
+class ULightNetDriver
+{
+	std::wstring m_name;
+	std::function<ULightNetClients()> m_factory;
+	ULightNetClients m_clients;
+	ULightNetSetup m_setup;
+	std::wstring m_setupError;
+	std::vector<char> m_address;
+	int m_family;
+	int m_sockType;
+
+	std::mutex m_mutex;
+	std::vector<int64_t> m_latenciesNs;
+	uint64_t m_requests;
+	size_t m_failed;
+	int64_t m_startNs;
+	int64_t m_endNs;
+
+	// Reports a setup that did not succeed from the first thread; returns
+	// false if there is nothing to run
+	bool ReportSetup(size_t thread, ULightTestThreadInfo *info);
+public:
+	ULightNetDriver(const std::wstring& name, std::function<ULightNetClients()> factory);
+
+	// Builds the client description; returns the number of threads to start.
+	// Does not throw: a failed, skipped or incomplete body is reported by the
+	// first thread instead.
+	size_t Prepare();
+
+	void RunThread(size_t thread, ULightTestThreadInfo *info);
+
+	ULightNetResults Results();
+
+	const std::wstring& Name() const { return m_name; }
+};
+
+}
+
+#endif // __ULightCpp__ULightNetDriver__
@@ -0,0 +1,247 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightOpenLoop.h"
+#include "ULightCpp.h"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <thread>
+
+namespace ULightCpp
+{
+
+// Gives the threads time to be created before the first operation is due
+static const int64_t StartDelayMs = 20;
+
+// The schedule is split into this many windows for finding saturation
+static const size_t Windows = 100;
+
+// Latencies are bucketed by power of two, each split into 8 linear steps, so
+// a bucket is never more than 12.5% wide
+static const int SubBucketBits = 3;
+static const size_t SubBuckets = 1 << SubBucketBits;
+static const size_t Buckets = (64 - SubBucketBits + 1) * SubBuckets;
+
+static int HighestBit(uint64_t value)
+{
+	int bit = 0;
+	for (int shift = 32; shift > 0; shift /= 2)
+	{
+		if (value >> shift)
+		{
+			value >>= shift;
+			bit += shift;
+		}
+	}
+	return bit;
+}
+
+static size_t BucketFor(int64_t ns)
+{
+	uint64_t value = (uint64_t)std::max<int64_t>(ns, 0);
+	if (value < SubBuckets)
+		return (size_t)value;
+	int bit = HighestBit(value);
+	return (bit - SubBucketBits + 1) * SubBuckets + ((value >> (bit - SubBucketBits)) & (SubBuckets - 1));
+}
+
+// Middle of the range of latencies that fall in the bucket
+static double BucketNs(size_t bucket)
+{
+	if (bucket < SubBuckets)
+		return (double)bucket;
+	int shift = (int)(bucket / SubBuckets) - 1;
+	double low = (double)((uint64_t)(SubBuckets + bucket % SubBuckets) << shift);
+	return low + (double)(1ull << shift) / 2.0;
+}
+
+ULightOpenLoop::ULightOpenLoop(const std::wstring& name, std::function<void()> fn, double startRate, double endRate, int64_t durationMs)
+ :	m_name(name), m_fn(fn), m_startRate(std::max(startRate, 0.0)), m_endRate(std::max(endRate, 0.0)),
+	m_durationSec(std::max<int64_t>(durationMs, 1) / 1000.0), m_next(0), m_histogram(Windows * Buckets), m_maxNs(0), m_errors(0)
+{
+	m_totalOps = (uint64_t)((m_startRate + m_endRate) / 2.0 * m_durationSec);
+}
+
+double ULightOpenLoop::ScheduledSeconds(uint64_t op) const
+{
+	// With a linear ramp the number of operations due by time t is
+	// r0*t + (r1-r0)*t^2/(2T); invert that for operation op
+	double a = (m_endRate - m_startRate) / (2.0 * m_durationSec);
+	double b = m_startRate;
+	if (std::fabs(a) < 1e-12)
+		return b > 0 ? op / b : 0;
+	return (-b + std::sqrt(b * b + 4.0 * a * op)) / (2.0 * a);
+}
+
+void ULightOpenLoop::Begin()
+{
+	m_next.store(0);
+	for (auto& count : m_histogram)
+		count.store(0, std::memory_order_relaxed);
+	m_maxNs = 0;
+	m_errors = 0;
+	m_start = Clock::now() + std::chrono::milliseconds(StartDelayMs);
+	m_lastEnd = m_start;
+}
+
+void ULightOpenLoop::Run()
+{
+	uint64_t completed = 0;
+	uint64_t errors = 0;
+	int64_t maxNs = 0;
+	std::wstring firstError;
+	Clock::time_point lastEnd = m_start;
+
+	for (;;)
+	{
+		uint64_t op = m_next.fetch_add(1, std::memory_order_relaxed);
+		if (op >= m_totalOps)
+			break;
+		Clock::time_point due = m_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(ScheduledSeconds(op)));
+		std::this_thread::sleep_until(due);
+		try
+		{
+			m_fn();
+		}
+		catch(UnitTestException ex)
+		{
+			if (errors++ == 0)
+				firstError = ex.error;
+		}
+		catch(UnitTestSkipException)
+		{
+			throw;
+		}
+		catch(UnitTestIncompleteException)
+		{
+			throw;
+		}
+		catch(...)
+		{
+			if (errors++ == 0)
+				firstError = L"Unexpected exception";
+		}
+		lastEnd = Clock::now();
+		int64_t latencyNs = std::chrono::duration_cast<std::chrono::nanoseconds>(lastEnd - due).count();
+		size_t window = (size_t)(op * Windows / m_totalOps);
+		m_histogram[window * Buckets + BucketFor(latencyNs)].fetch_add(1, std::memory_order_relaxed);
+		maxNs = std::max(maxNs, latencyNs);
+		++completed;
+	}
+
+	{
+		std::lock_guard<std::mutex> lck { m_mutex };
+		m_errors += errors;
+		m_maxNs = std::max(m_maxNs, maxNs);
+		m_lastEnd = std::max(m_lastEnd, lastEnd);
+	}
+
+	if (errors > 0)
+	{
+		std::wstringstream str;
+		str << errors << L" of " << completed << L" operations failed: " << firstError;
+		throw UnitTestException(str.str(), L"", 0);
+	}
+}
+
+// Sums the histograms of windows first to last - 1
+std::vector<uint64_t> ULightOpenLoop::WindowCounts(size_t first, size_t last) const
+{
+	std::vector<uint64_t> counts(Buckets, 0);
+	for (size_t window = first; window < last; ++window)
+	{
+		for (size_t bucket = 0; bucket < Buckets; ++bucket)
+			counts[bucket] += m_histogram[window * Buckets + bucket].load(std::memory_order_relaxed);
+	}
+	return counts;
+}
+
+static uint64_t TotalCount(const std::vector<uint64_t>& counts)
+{
+	uint64_t total = 0;
+	for (uint64_t count : counts)
+		total += count;
+	return total;
+}
+
+static double PercentileNs(const std::vector<uint64_t>& counts, double percentile)
+{
+	uint64_t total = TotalCount(counts);
+	if (total == 0)
+		return 0;
+	uint64_t rank = std::min(total - 1, (uint64_t)(percentile * total));
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < counts.size(); ++bucket)
+	{
+		seen += counts[bucket];
+		if (seen > rank)
+			return BucketNs(bucket);
+	}
+	return 0;
+}
+
+double ULightOpenLoop::SaturationRate() const
+{
+	// Latency stays flat while the system keeps up and climbs steadily once
+	// it can't.  Compare the median of each 1% window of the schedule against
+	// the first 10%.
+	if (m_startRate == m_endRate || m_totalOps < Windows)
+		return 0;
+	std::vector<uint64_t> baselineCounts = WindowCounts(0, Windows / 10);
+	if (TotalCount(baselineCounts) == 0)
+		return 0;
+	double baseline = PercentileNs(baselineCounts, 0.50);
+	double threshold = std::max(baseline * 10, baseline + 1000000);
+	for (size_t window = Windows / 10; window < Windows; ++window)
+	{
+		std::vector<uint64_t> counts = WindowCounts(window, window + 1);
+		if (TotalCount(counts) > 0 && PercentileNs(counts, 0.50) > threshold)
+		{
+			// Windows are numbered by scheduled operation, so this is when the
+			// first operation of the window was due
+			double t = ScheduledSeconds((window * m_totalOps + Windows - 1) / Windows);
+			return m_startRate + (m_endRate - m_startRate) * t / m_durationSec;
+		}
+	}
+	return 0;
+}
+
+ULightRateResults ULightOpenLoop::Results()
+{
+	std::lock_guard<std::mutex> lck { m_mutex };
+	std::vector<uint64_t> counts = WindowCounts(0, Windows);
+
+	ULightRateResults results;
+	results.name = m_name;
+	results.targetOps = m_totalOps;
+	results.completed = TotalCount(counts);
+	results.saturationRate = SaturationRate();
+	results.errors = m_errors;
+	results.targetRate = m_durationSec > 0 ? m_totalOps / m_durationSec : 0;
+	double elapsedSec = std::chrono::duration<double>(m_lastEnd - m_start).count();
+	results.achievedRate = elapsedSec > 0 ? results.completed / elapsedSec : 0;
+	results.p50Us = PercentileNs(counts, 0.50) / 1000.0;
+	results.p90Us = PercentileNs(counts, 0.90) / 1000.0;
+	results.p99Us = PercentileNs(counts, 0.99) / 1000.0;
+	results.p999Us = PercentileNs(counts, 0.999) / 1000.0;
+	// The histogram rounds, but the maximum is kept exactly
+	results.maxUs = m_maxNs / 1000.0;
+	return results;
+}
+
+}
@@ -0,0 +1,96 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightOpenLoop__
+#define __ULightCpp__ULightOpenLoop__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ULightCpp
+{
+
+struct ULightRateResults
+{
+	ULightRateResults()
+	 :	targetOps(0), completed(0), errors(0), targetRate(0), achievedRate(0),
+		p50Us(0), p90Us(0), p99Us(0), p999Us(0), maxUs(0), saturationRate(0)
+		{}
+
+	std::wstring name;
+	uint64_t targetOps;
+	uint64_t completed;
+	uint64_t errors;
+	double targetRate;		// Mean operations per second over the schedule
+	double achievedRate;
+	// Latency from each operation's scheduled start, not its actual start
+	double p50Us;
+	double p90Us;
+	double p99Us;
+	double p999Us;
+	double maxUs;
+	double saturationRate;	// Scheduled rate where latency took off during a ramp, 0 if it never did
+};
+
+// Issues operations on a fixed schedule regardless of how long earlier ones
+// took.  A thread that falls behind starts the next overdue operation straight
+// away, and that lateness shows up in its latency, so a stalled server cannot
+// hide by slowing the load down.
+class ULightOpenLoop
+{
+	typedef std::chrono::steady_clock Clock;
+
+	std::wstring m_name;
+	std::function<void()> m_fn;
+	double m_startRate;
+	double m_endRate;
+	double m_durationSec;
+	uint64_t m_totalOps;
+	Clock::time_point m_start;
+	Clock::time_point m_lastEnd;
+	std::atomic<uint64_t> m_next;
+	std::mutex m_mutex;
+	// Latency histogram for each 1% of the schedule, so memory does not grow
+	// with the number of operations.  Indexed by window * Buckets + bucket.
+	std::vector<std::atomic<uint64_t>> m_histogram;
+	int64_t m_maxNs;
+	uint64_t m_errors;
+
+	double ScheduledSeconds(uint64_t op) const;
+	std::vector<uint64_t> WindowCounts(size_t first, size_t last) const;
+	double SaturationRate() const;
+public:
+	ULightOpenLoop(const std::wstring& name, std::function<void()> fn, double startRate, double endRate, int64_t durationMs);
+
+	// Sets time zero of the schedule; called before the task threads start
+	void Begin();
+
+	// Body of each task thread
+	void Run();
+
+	ULightRateResults Results();
+
+	const std::wstring& Name() const { return m_name; }
+};
+
+}
+
+#endif // __ULightCpp__ULightOpenLoop__
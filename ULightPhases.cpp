@@ -0,0 +1,141 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightPhases.h"
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+
+namespace ULightCpp
+{
+
+std::atomic<uint64_t> g_phaseGeneration(1);
+thread_local ULightPhaseTree *t_phaseTree = nullptr;
+thread_local uint64_t t_phaseGeneration = 0;
+
+static std::mutex s_phaseMutex;
+static std::vector<std::wstring> s_phaseNames;
+static std::vector<std::unique_ptr<ULightPhaseTree>> s_trees;
+// Trees from earlier tests; a thread that has not yet noticed the new
+// generation may still hold one so they are never freed
+static std::vector<std::unique_ptr<ULightPhaseTree>> s_retiredTrees;
+
+ULightPhaseTree::ULightPhaseTree() : current(0)
+{
+	nodes.reserve(64);
+	nodes.push_back(ULightPhaseNode { ULightNoPhaseNode, 0, ULightNoPhaseNode, ULightNoPhaseNode, 0, 0, 0 });
+}
+
+size_t ULightPhaseTree::Enter(size_t phase)
+{
+	size_t last = ULightNoPhaseNode;
+	for (size_t child = nodes[current].firstChild; child != ULightNoPhaseNode; child = nodes[child].nextSibling)
+	{
+		if (nodes[child].phase == phase)
+			return current = child;
+		last = child;
+	}
+
+	// First time this phase has been seen here; keep siblings in the order
+	// they were first entered
+	size_t node = nodes.size();
+	nodes.push_back(ULightPhaseNode { phase, current, ULightNoPhaseNode, ULightNoPhaseNode, 0, 0, 0 });
+	if (last == ULightNoPhaseNode)
+		nodes[current].firstChild = node;
+	else
+		nodes[last].nextSibling = node;
+	return current = node;
+}
+
+size_t PhaseId(const wchar_t *name)
+{
+	std::lock_guard<std::mutex> lck { s_phaseMutex };
+	auto it = std::find(s_phaseNames.begin(), s_phaseNames.end(), name);
+	if (it != s_phaseNames.end())
+		return it - s_phaseNames.begin();
+	s_phaseNames.push_back(name);
+	return s_phaseNames.size() - 1;
+}
+
+std::wstring PhaseName(size_t phase)
+{
+	std::lock_guard<std::mutex> lck { s_phaseMutex };
+	return phase < s_phaseNames.size() ? s_phaseNames[phase] : std::wstring();
+}
+
+ULightPhaseTree *NewPhaseTree()
+{
+	std::lock_guard<std::mutex> lck { s_phaseMutex };
+	s_trees.emplace_back(new ULightPhaseTree());
+	t_phaseTree = s_trees.back().get();
+	t_phaseGeneration = g_phaseGeneration.load(std::memory_order_relaxed);
+	return t_phaseTree;
+}
+
+void ResetPhases()
+{
+	std::lock_guard<std::mutex> lck { s_phaseMutex };
+	for (auto& tree : s_trees)
+		s_retiredTrees.push_back(std::move(tree));
+	s_trees.clear();
+	g_phaseGeneration.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Adds the subtree under from into the merged tree under to, matching
+// children by phase so the same path from different threads is combined
+static void MergeTree(ULightPhaseTree& merged, size_t to, const ULightPhaseTree& tree, size_t from)
+{
+	for (size_t child = tree.nodes[from].firstChild; child != ULightNoPhaseNode; child = tree.nodes[child].nextSibling)
+	{
+		const ULightPhaseNode& source = tree.nodes[child];
+		merged.current = to;
+		size_t node = merged.Enter(source.phase);
+		merged.nodes[node].calls += source.calls;
+		merged.nodes[node].inclusiveNs += source.inclusiveNs;
+		merged.nodes[node].childNs += source.childNs;
+		MergeTree(merged, node, tree, child);
+	}
+}
+
+static void Flatten(const ULightPhaseTree& merged, size_t from, int depth, std::vector<ULightPhaseStat>& stats)
+{
+	for (size_t child = merged.nodes[from].firstChild; child != ULightNoPhaseNode; child = merged.nodes[child].nextSibling)
+	{
+		const ULightPhaseNode& node = merged.nodes[child];
+		ULightPhaseStat stat;
+		stat.name = s_phaseNames[node.phase];
+		stat.depth = depth;
+		stat.calls = node.calls;
+		stat.inclusiveNs = node.inclusiveNs;
+		stat.exclusiveNs = std::max<int64_t>(node.inclusiveNs - node.childNs, 0);
+		stats.push_back(stat);
+		Flatten(merged, child, depth + 1, stats);
+	}
+}
+
+std::vector<ULightPhaseStat> CollectPhases()
+{
+	std::lock_guard<std::mutex> lck { s_phaseMutex };
+	ULightPhaseTree merged;
+	for (auto& tree : s_trees)
+		MergeTree(merged, 0, *tree, 0);
+	std::vector<ULightPhaseStat> stats;
+	Flatten(merged, 0, 0, stats);
+	return stats;
+}
+
+}
@@ -0,0 +1,116 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightPhases__
+#define __ULightCpp__ULightPhases__
+
+#include "ULightTrace.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ULightCpp
+{
+
+struct ULightPhaseNode
+{
+	size_t phase;
+	size_t parent;
+	size_t firstChild;
+	size_t nextSibling;
+	uint64_t calls;
+	int64_t inclusiveNs;
+	int64_t childNs;		// Time spent in nested phases
+};
+
+static const size_t ULightNoPhaseNode = (size_t)-1;
+
+// One per thread.  Only the owning thread touches it while a test runs, and
+// it is read once the test's threads have been joined.
+struct ULightPhaseTree
+{
+	ULightPhaseTree();
+
+	std::vector<ULightPhaseNode> nodes;	// nodes[0] is the root
+	size_t current;
+
+	// Finds or adds the child of the current node and makes it current
+	size_t Enter(size_t phase);
+};
+
+// A node of the tree merged across threads, flattened depth first
+struct ULightPhaseStat
+{
+	ULightPhaseStat() : depth(0), calls(0), inclusiveNs(0), exclusiveNs(0) {}
+
+	std::wstring name;
+	int depth;
+	uint64_t calls;
+	int64_t inclusiveNs;
+	int64_t exclusiveNs;
+};
+
+size_t PhaseId(const wchar_t *name);
+std::wstring PhaseName(size_t phase);
+
+ULightPhaseTree *NewPhaseTree();
+
+extern std::atomic<uint64_t> g_phaseGeneration;
+extern thread_local ULightPhaseTree *t_phaseTree;
+extern thread_local uint64_t t_phaseGeneration;
+
+// Called by the harness around each test
+void ResetPhases();
+std::vector<ULightPhaseStat> CollectPhases();
+
+class ULightPhase
+{
+	ULightPhaseTree *m_tree;
+	size_t m_node;
+	int64_t m_startNs;
+public:
+	explicit ULightPhase(size_t phase)
+	{
+		ULightPhaseTree *tree = t_phaseTree;
+		if (tree == nullptr || t_phaseGeneration != g_phaseGeneration.load(std::memory_order_relaxed))
+			tree = NewPhaseTree();
+		m_tree = tree;
+		m_node = tree->Enter(phase);
+		m_startNs = TraceNowNs();
+	}
+
+	~ULightPhase()
+	{
+		int64_t endNs = TraceNowNs();
+		int64_t elapsed = endNs - m_startNs;
+		ULightPhaseNode& node = m_tree->nodes[m_node];
+		if (g_traceEnabled.load(std::memory_order_relaxed))
+			TraceEvent(ULightTraceCategory::Phase, (uint32_t)node.phase, 0, m_startNs, endNs);
+		++node.calls;
+		node.inclusiveNs += elapsed;
+		m_tree->nodes[node.parent].childNs += elapsed;
+		m_tree->current = node.parent;
+	}
+
+	ULightPhase(const ULightPhase&) = delete;
+	ULightPhase& operator=(const ULightPhase&) = delete;
+};
+
+}
+
+#endif // __ULightCpp__ULightPhases__
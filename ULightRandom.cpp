@@ -0,0 +1,315 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightRandom.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace ULightCpp
+{
+
+const char *ULightAlphanumeric = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+static uint64_t SplitMix64(uint64_t& x)
+{
+	uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// High 64 bits of the 128 bit product a * b, with the low 64 in low
+static inline uint64_t MulHigh64(uint64_t a, uint64_t b, uint64_t& low)
+{
+#ifdef __SIZEOF_INT128__
+	__extension__ typedef unsigned __int128 Product;
+	Product m = (Product)a * b;
+	low = (uint64_t)m;
+	return (uint64_t)(m >> 64);
+#else
+	uint64_t aLow = a & 0xffffffff, aHigh = a >> 32;
+	uint64_t bLow = b & 0xffffffff, bHigh = b >> 32;
+	uint64_t p0 = aLow * bLow;
+	uint64_t p1 = aLow * bHigh;
+	uint64_t p2 = aHigh * bLow;
+	uint64_t p3 = aHigh * bHigh;
+	uint64_t middle = (p0 >> 32) + (p1 & 0xffffffff) + (p2 & 0xffffffff);
+	low = a * b;
+	return p3 + (p1 >> 32) + (p2 >> 32) + (middle >> 32);
+#endif
+}
+
+ULightRandom::ULightRandom(uint64_t seed)
+{
+	Seed(seed);
+}
+
+void ULightRandom::Seed(uint64_t seed)
+{
+	for (auto& word : m_state)
+		word = SplitMix64(seed);
+	for (auto& word : m_lanes)
+	{
+		for (auto& lane : word)
+			lane = SplitMix64(seed);
+	}
+}
+
+// Four values, one from each lane
+void ULightRandom::NextBlock(uint64_t *out)
+{
+#ifdef __AVX2__
+	__m256i s0 = _mm256_loadu_si256((const __m256i *)m_lanes[0]);
+	__m256i s1 = _mm256_loadu_si256((const __m256i *)m_lanes[1]);
+	__m256i s2 = _mm256_loadu_si256((const __m256i *)m_lanes[2]);
+	__m256i s3 = _mm256_loadu_si256((const __m256i *)m_lanes[3]);
+	// AVX2 has no 64 bit multiply, but x * 5 and x * 9 are a shift and an add
+	__m256i x = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+	x = _mm256_or_si256(_mm256_slli_epi64(x, 7), _mm256_srli_epi64(x, 57));
+	x = _mm256_add_epi64(_mm256_slli_epi64(x, 3), x);
+	_mm256_storeu_si256((__m256i *)out, x);
+	__m256i t = _mm256_slli_epi64(s1, 17);
+	s2 = _mm256_xor_si256(s2, s0);
+	s3 = _mm256_xor_si256(s3, s1);
+	s1 = _mm256_xor_si256(s1, s2);
+	s0 = _mm256_xor_si256(s0, s3);
+	s2 = _mm256_xor_si256(s2, t);
+	s3 = _mm256_or_si256(_mm256_slli_epi64(s3, 45), _mm256_srli_epi64(s3, 19));
+	_mm256_storeu_si256((__m256i *)m_lanes[0], s0);
+	_mm256_storeu_si256((__m256i *)m_lanes[1], s1);
+	_mm256_storeu_si256((__m256i *)m_lanes[2], s2);
+	_mm256_storeu_si256((__m256i *)m_lanes[3], s3);
+#else
+	for (int lane = 0; lane < 4; ++lane)
+	{
+		uint64_t *s0 = &m_lanes[0][lane], *s1 = &m_lanes[1][lane], *s2 = &m_lanes[2][lane], *s3 = &m_lanes[3][lane];
+		out[lane] = Rotl(*s1 * 5, 7) * 9;
+		uint64_t t = *s1 << 17;
+		*s2 ^= *s0;
+		*s3 ^= *s1;
+		*s1 ^= *s2;
+		*s0 ^= *s3;
+		*s2 ^= t;
+		*s3 = Rotl(*s3, 45);
+	}
+#endif
+}
+
+void ULightRandom::Fill(uint64_t *out, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+		NextBlock(out + i);
+	if (i < count)
+	{
+		uint64_t block[4];
+		NextBlock(block);
+		std::memcpy(out + i, block, (count - i) * sizeof(uint64_t));
+	}
+}
+
+uint64_t ULightRandom::Uniform(uint64_t bound)
+{
+	uint64_t low;
+	uint64_t high = MulHigh64(Next(), bound, low);
+	if (low < bound)
+	{
+		uint64_t threshold = -bound % bound;
+		while (low < threshold)
+			high = MulHigh64(Next(), bound, low);
+	}
+	return high;
+}
+
+// Maps count fresh values onto [lo, lo + range), or all 64 bit values when
+// range is 0
+void ULightRandom::FillUniformBlock(uint64_t *out, size_t count, uint64_t lo, uint64_t range)
+{
+	Fill(out, count);
+	if (range == 0)
+		return;
+	uint64_t low;
+	for (size_t i = 0; i < count; ++i)
+		out[i] = lo + MulHigh64(out[i], range, low);
+}
+
+void ULightRandom::FillBytes(void *out, size_t bytes)
+{
+	char *dest = (char *)out;
+	uint64_t block[256];
+	while (bytes > 0)
+	{
+		size_t n = std::min(bytes, sizeof(block));
+		Fill(block, (n + 7) / 8);
+		std::memcpy(dest, block, n);
+		dest += n;
+		bytes -= n;
+	}
+}
+
+void ULightRandom::FillString(char *out, size_t length, const char *alphabet)
+{
+	// Scale each random byte onto the alphabet; for alphabets that don't
+	// divide 256 some characters are very slightly more likely
+	size_t size = std::strlen(alphabet);
+	FillBytes(out, length);
+	for (size_t i = 0; i < length; ++i)
+		out[i] = alphabet[((size_t)(unsigned char)out[i] * size) >> 8];
+}
+
+std::string ULightRandom::String(size_t length, const char *alphabet)
+{
+	std::string s(length, '\0');
+	if (length > 0)
+		FillString(&s[0], length, alphabet);
+	return s;
+}
+
+void ULightRandom::FillSequential(uint64_t *out, size_t count, uint64_t start, double holeFraction)
+{
+	// Gaps between kept values are geometric
+	double logHole = holeFraction > 0 && holeFraction < 1 ? std::log(holeFraction) : 0;
+	uint64_t value = start;
+	uint64_t block[256];
+	while (count > 0)
+	{
+		size_t n = std::min<size_t>(count, 256);
+		Fill(block, n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			if (logHole < 0)
+			{
+				double u = ((block[i] >> 11) + 1) * (1.0 / 9007199254740992.0);
+				value += (uint64_t)(std::log(u) / logHole);
+			}
+			*out++ = value++;
+		}
+		count -= n;
+	}
+}
+
+static double Helper1(double x)
+{
+	return std::fabs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+static double Helper2(double x)
+{
+	return std::fabs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3.0) * (1 + 0.25 * x));
+}
+
+ULightZipf::ULightZipf(uint64_t n, double exponent)
+ :	m_n(std::max<uint64_t>(n, 1)), m_exponent(exponent)
+{
+	m_hIntegralX1 = HIntegral(1.5) - 1;
+	m_hIntegralN = HIntegral(m_n + 0.5);
+	m_s = 2 - HIntegralInverse(HIntegral(2.5) - H(2));
+}
+
+double ULightZipf::H(double x) const
+{
+	return std::exp(-m_exponent * std::log(x));
+}
+
+double ULightZipf::HIntegral(double x) const
+{
+	double logX = std::log(x);
+	return Helper2((1 - m_exponent) * logX) * logX;
+}
+
+double ULightZipf::HIntegralInverse(double x) const
+{
+	double t = std::max(x * (1 - m_exponent), -1.0);
+	return std::exp(Helper1(t) * x);
+}
+
+uint64_t ULightZipf::Next(ULightRandom& random) const
+{
+	for (;;)
+	{
+		double u = m_hIntegralN + random.Double() * (m_hIntegralX1 - m_hIntegralN);
+		double x = HIntegralInverse(u);
+		uint64_t k = (uint64_t)std::min(std::max(x + 0.5, 1.0), (double)m_n);
+		if (k - x <= m_s || u >= HIntegral(k + 0.5) - H((double)k))
+			return k - 1;
+	}
+}
+
+void ULightZipf::Fill(ULightRandom& random, uint64_t *out, size_t count) const
+{
+	for (size_t i = 0; i < count; ++i)
+		out[i] = Next(random);
+}
+
+static std::atomic<uint64_t> s_runSeed(0x5eed);
+static std::atomic<uint64_t> s_testSeed(0x5eed);
+static std::atomic<uint64_t> s_randomGeneration(1);
+static thread_local uint64_t t_randomStream = 0;
+static thread_local uint64_t t_randomGeneration = 0;
+static thread_local ULightRandom t_random;
+
+void SetRandomSeed(uint64_t seed)
+{
+	s_runSeed = seed;
+	s_testSeed = seed;
+	++s_randomGeneration;
+}
+
+uint64_t GetRandomSeed()
+{
+	return s_runSeed;
+}
+
+void ResetRandom(const std::wstring& testName)
+{
+	// FNV-1a of the name, so the seed doesn't depend on test order
+	uint64_t hash = 14695981039346656037ULL;
+	for (wchar_t c : testName)
+	{
+		hash ^= (uint64_t)c;
+		hash *= 1099511628211ULL;
+	}
+	uint64_t seed = s_runSeed ^ hash;
+	s_testSeed = SplitMix64(seed);
+	++s_randomGeneration;
+}
+
+void SetRandomStream(uint64_t stream)
+{
+	t_randomStream = stream;
+	t_randomGeneration = 0;
+}
+
+ULightRandom& TestRandom()
+{
+	uint64_t generation = s_randomGeneration.load(std::memory_order_relaxed);
+	if (t_randomGeneration != generation)
+	{
+		uint64_t seed = s_testSeed.load(std::memory_order_relaxed) + t_randomStream;
+		t_random.Seed(SplitMix64(seed));
+		t_randomGeneration = generation;
+	}
+	return t_random;
+}
+
+}
@@ -0,0 +1,131 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightRandom__
+#define __ULightCpp__ULightRandom__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+namespace ULightCpp
+{
+
+extern const char *ULightAlphanumeric;
+
+// xoshiro256** with a second, four lane generator for bulk fills.  Given the
+// same seed and the same sequence of calls the output is identical on every
+// platform, with or without AVX2.
+class ULightRandom
+{
+	uint64_t m_state[4];
+	uint64_t m_lanes[4][4];		// [word][lane]
+
+	static uint64_t Rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+	void NextBlock(uint64_t *out);
+	void FillUniformBlock(uint64_t *out, size_t count, uint64_t lo, uint64_t range);
+public:
+	explicit ULightRandom(uint64_t seed = 0);
+
+	void Seed(uint64_t seed);
+
+	uint64_t Next()
+	{
+		uint64_t result = Rotl(m_state[1] * 5, 7) * 9;
+		uint64_t t = m_state[1] << 17;
+		m_state[2] ^= m_state[0];
+		m_state[3] ^= m_state[1];
+		m_state[1] ^= m_state[2];
+		m_state[0] ^= m_state[3];
+		m_state[2] ^= t;
+		m_state[3] = Rotl(m_state[3], 45);
+		return result;
+	}
+
+	// Unbiased value in [0, bound) (Lemire's multiply and reject)
+	uint64_t Uniform(uint64_t bound);
+
+	// Value in [lo, hi]
+	uint64_t Uniform(uint64_t lo, uint64_t hi) { return hi - lo == UINT64_MAX ? Next() : lo + Uniform(hi - lo + 1); }
+
+	// Value in [0, 1)
+	double Double() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+	// Bulk versions write straight into the caller's buffer
+	void Fill(uint64_t *out, size_t count);
+	void FillBytes(void *out, size_t bytes);
+	void FillString(char *out, size_t length, const char *alphabet = ULightAlphanumeric);
+	std::string String(size_t length, const char *alphabet = ULightAlphanumeric);
+
+	// Increasing values from start where each value after start is skipped
+	// with probability holeFraction, so a lookup of a value in the range misses
+	// that often
+	void FillSequential(uint64_t *out, size_t count, uint64_t start, double holeFraction);
+
+	// Values in [lo, hi].  Bias is below (hi - lo) / 2^64 rather than zero so
+	// the bulk path needs no rejection loop.
+	template<typename T>
+	void FillUniform(T *out, size_t count, T lo, T hi)
+	{
+		static_assert(std::is_integral<T>::value, "FillUniform needs an integer type");
+		uint64_t range = (uint64_t)hi - (uint64_t)lo + 1;
+		uint64_t block[256];
+		while (count > 0)
+		{
+			size_t n = count < 256 ? count : 256;
+			FillUniformBlock(block, n, (uint64_t)lo, range);
+			for (size_t i = 0; i < n; ++i)
+				out[i] = (T)block[i];
+			out += n;
+			count -= n;
+		}
+	}
+};
+
+// Zipf distributed ranks in [0, n), with rank 0 the most frequent.  Uses
+// rejection inversion (Hormann and Derflinger), so setup is constant time
+// however large n is.
+class ULightZipf
+{
+	uint64_t m_n;
+	double m_exponent;
+	double m_hIntegralX1;
+	double m_hIntegralN;
+	double m_s;
+
+	double H(double x) const;
+	double HIntegral(double x) const;
+	double HIntegralInverse(double x) const;
+public:
+	ULightZipf(uint64_t n, double exponent = 0.99);
+
+	uint64_t Next(ULightRandom& random) const;
+	void Fill(ULightRandom& random, uint64_t *out, size_t count) const;
+};
+
+// Seeds used by RANDOM.  Each test thread gets its own stream derived from
+// the run seed, the test name and the thread's index in the test.
+void SetRandomSeed(uint64_t seed);
+uint64_t GetRandomSeed();
+void ResetRandom(const std::wstring& testName);
+void SetRandomStream(uint64_t stream);
+ULightRandom& TestRandom();
+
+}
+
+#endif // __ULightCpp__ULightRandom__
@@ -0,0 +1,340 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightResultsFile.h"
+#include "ULightCpp.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <sstream>
+
+namespace ULightCpp
+{
+
+static const char *ResultsHeader = "ULightResults\t2";
+// Files from before the report details were written are still read
+static const char *ResultsHeaderV1 = "ULightResults\t1";
+
+// Keeps the file plain ASCII whatever the platform's wchar_t and locale
+static std::string Escape(const std::wstring& s)
+{
+	std::string out;
+	for (wchar_t c : s)
+	{
+		if (c == L'\\')
+			out += "\\\\";
+		else if (c == L'\t')
+			out += "\\t";
+		else if (c == L'\n')
+			out += "\\n";
+		else if (c == L'\r')
+			out += "\\r";
+		else if (c >= 0x20 && c < 0x7f)
+			out += (char)c;
+		else
+		{
+			char buf[16];
+			std::snprintf(buf, sizeof(buf), "\\u%06lx", (unsigned long)c);
+			out += buf;
+		}
+	}
+	return out;
+}
+
+static std::wstring Unescape(const std::string& s)
+{
+	std::wstring out;
+	for (size_t i = 0; i < s.size(); ++i)
+	{
+		if (s[i] != '\\' || i + 1 == s.size())
+		{
+			out += (wchar_t)(unsigned char)s[i];
+			continue;
+		}
+		char c = s[++i];
+		if (c == 't')
+			out += L'\t';
+		else if (c == 'n')
+			out += L'\n';
+		else if (c == 'r')
+			out += L'\r';
+		else if (c == 'u' && i + 6 < s.size())
+		{
+			out += (wchar_t)std::strtoul(s.substr(i + 1, 6).c_str(), nullptr, 16);
+			i += 6;
+		}
+		else
+			out += (wchar_t)c;
+	}
+	return out;
+}
+
+template<typename T>
+static std::string JoinList(const std::vector<T>& values)
+{
+	std::stringstream str;
+	str.precision(std::numeric_limits<double>::max_digits10);
+	for (size_t i = 0; i < values.size(); ++i)
+		str << (i > 0 ? "," : "") << values[i];
+	return str.str();
+}
+
+static std::vector<std::string> SplitList(const std::string& s)
+{
+	std::vector<std::string> values;
+	std::stringstream str(s);
+	std::string value;
+	while (std::getline(str, value, ','))
+		values.push_back(value);
+	return values;
+}
+
+static void WriteDetails(std::ostream& out, const ULightTestInfo& testInfo)
+{
+	if (testInfo.compared)
+	{
+		const ULightCompareResult& cmp = testInfo.comparison;
+		out << "compare\t" << cmp.speedup << "\t" << cmp.speedupLow << "\t" << cmp.speedupHigh << "\t" << cmp.baselineNs
+			<< "\t" << cmp.candidateNs << "\t" << cmp.baselineBatch << "\t" << cmp.candidateBatch << "\t" << cmp.rounds << "\n";
+	}
+	for (auto& point : testInfo.sweep)
+		out << "sweep\t" << point.bytes << "\t" << point.bytesPerSecond << "\t" << Escape(point.level) << "\n";
+	for (auto& phase : testInfo.phases)
+	{
+		out << "phase\t" << Escape(phase.name) << "\t" << phase.depth << "\t" << phase.calls << "\t" << phase.inclusiveNs
+			<< "\t" << phase.exclusiveNs << "\n";
+	}
+	for (auto& timeline : testInfo.counters)
+	{
+		out << "counter\t" << Escape(timeline.name) << "\t" << timeline.total << "\t" << timeline.minRate << "\t" << timeline.maxRate
+			<< "\t" << timeline.meanRate << "\t" << timeline.stddevRate << "\t" << (timeline.collapsed ? 1 : 0) << "\t" << timeline.collapseMs
+			<< "\t" << JoinList(timeline.rates) << "\t" << JoinList(timeline.timesMs) << "\n";
+	}
+	for (auto& rate : testInfo.rates)
+	{
+		out << "rate\t" << Escape(rate.name) << "\t" << rate.targetOps << "\t" << rate.completed << "\t" << rate.errors
+			<< "\t" << rate.targetRate << "\t" << rate.achievedRate << "\t" << rate.p50Us << "\t" << rate.p90Us << "\t" << rate.p99Us
+			<< "\t" << rate.p999Us << "\t" << rate.maxUs << "\t" << rate.saturationRate << "\n";
+	}
+	for (auto& net : testInfo.nets)
+	{
+		out << "net\t" << Escape(net.name) << "\t" << net.connections << "\t" << net.failedConnections << "\t" << net.requests
+			<< "\t" << net.elapsedUs << "\t" << net.p50Us << "\t" << net.p99Us << "\t" << net.maxUs << "\n";
+	}
+	for (auto& task : testInfo.sched)
+	{
+		const ULightSchedSample& total = task.total;
+		out << "sched\t" << Escape(task.name) << "\t" << task.threads << "\t" << (task.paced ? 1 : 0) << "\t" << total.wallNs
+			<< "\t" << total.cpuNs << "\t" << total.waitNs << "\t" << total.voluntary << "\t" << total.involuntary
+			<< "\t" << total.migrations << "\n";
+	}
+	for (auto& check : testInfo.checks)
+	{
+		out << "check\t" << Escape(check.filename) << "\t" << check.lineNumber << "\t" << check.count << "\t" << check.threads
+			<< "\t" << Escape(check.message) << "\n";
+	}
+}
+
+// Reads a line written by WriteDetails into the last test read.  Lines it
+// does not recognise are skipped.
+static void ReadDetail(const std::vector<std::string>& fields, ULightTestRecord& record)
+{
+	auto i64 = [&](size_t i) { return (int64_t)std::strtoll(fields[i].c_str(), nullptr, 10); };
+	auto u64 = [&](size_t i) { return (uint64_t)std::strtoull(fields[i].c_str(), nullptr, 10); };
+	auto dbl = [&](size_t i) { return std::strtod(fields[i].c_str(), nullptr); };
+	const std::string& kind = fields[0];
+	if (kind == "compare" && fields.size() == 9)
+	{
+		record.compared = true;
+		ULightCompareResult& cmp = record.comparison;
+		cmp.speedup = dbl(1);
+		cmp.speedupLow = dbl(2);
+		cmp.speedupHigh = dbl(3);
+		cmp.baselineNs = dbl(4);
+		cmp.candidateNs = dbl(5);
+		cmp.baselineBatch = (size_t)u64(6);
+		cmp.candidateBatch = (size_t)u64(7);
+		cmp.rounds = (size_t)u64(8);
+	}
+	else if (kind == "sweep" && fields.size() == 4)
+	{
+		ULightSweepPoint point;
+		point.bytes = (size_t)u64(1);
+		point.bytesPerSecond = dbl(2);
+		point.level = Unescape(fields[3]);
+		record.sweep.push_back(point);
+	}
+	else if (kind == "phase" && fields.size() == 6)
+	{
+		ULightPhaseStat phase;
+		phase.name = Unescape(fields[1]);
+		phase.depth = (int)i64(2);
+		phase.calls = u64(3);
+		phase.inclusiveNs = i64(4);
+		phase.exclusiveNs = i64(5);
+		record.phases.push_back(phase);
+	}
+	else if (kind == "counter" && fields.size() >= 9)
+	{
+		ULightCounterTimeline timeline;
+		timeline.name = Unescape(fields[1]);
+		timeline.total = u64(2);
+		timeline.minRate = dbl(3);
+		timeline.maxRate = dbl(4);
+		timeline.meanRate = dbl(5);
+		timeline.stddevRate = dbl(6);
+		timeline.collapsed = fields[7] == "1";
+		timeline.collapseMs = i64(8);
+		// Empty lists leave no trailing field
+		if (fields.size() > 9)
+		{
+			for (auto& rate : SplitList(fields[9]))
+				timeline.rates.push_back(std::strtod(rate.c_str(), nullptr));
+		}
+		if (fields.size() > 10)
+		{
+			for (auto& time : SplitList(fields[10]))
+				timeline.timesMs.push_back(std::strtoll(time.c_str(), nullptr, 10));
+		}
+		record.counters.push_back(timeline);
+	}
+	else if (kind == "rate" && fields.size() == 13)
+	{
+		ULightRateResults rate;
+		rate.name = Unescape(fields[1]);
+		rate.targetOps = u64(2);
+		rate.completed = u64(3);
+		rate.errors = u64(4);
+		rate.targetRate = dbl(5);
+		rate.achievedRate = dbl(6);
+		rate.p50Us = dbl(7);
+		rate.p90Us = dbl(8);
+		rate.p99Us = dbl(9);
+		rate.p999Us = dbl(10);
+		rate.maxUs = dbl(11);
+		rate.saturationRate = dbl(12);
+		record.rates.push_back(rate);
+	}
+	else if (kind == "net" && fields.size() == 9)
+	{
+		ULightNetResults net;
+		net.name = Unescape(fields[1]);
+		net.connections = (size_t)u64(2);
+		net.failedConnections = (size_t)u64(3);
+		net.requests = u64(4);
+		net.elapsedUs = i64(5);
+		net.p50Us = dbl(6);
+		net.p99Us = dbl(7);
+		net.maxUs = dbl(8);
+		record.nets.push_back(net);
+	}
+	else if (kind == "sched" && fields.size() == 10)
+	{
+		ULightTaskSched task;
+		task.name = Unescape(fields[1]);
+		task.threads = (size_t)u64(2);
+		task.paced = fields[3] == "1";
+		task.total.wallNs = i64(4);
+		task.total.cpuNs = i64(5);
+		task.total.waitNs = i64(6);
+		task.total.voluntary = i64(7);
+		task.total.involuntary = i64(8);
+		task.total.migrations = i64(9);
+		record.sched.push_back(task);
+	}
+	else if (kind == "check" && fields.size() >= 5)
+	{
+		ULightCheckResult check;
+		check.filename = Unescape(fields[1]);
+		check.lineNumber = (int)i64(2);
+		check.count = u64(3);
+		check.threads = (size_t)u64(4);
+		if (fields.size() > 5)
+			check.message = Unescape(fields[5]);
+		record.checks.push_back(check);
+	}
+}
+
+bool WriteResultsFile(const std::string& path, const std::vector<ULightTestInfo *>& tests, int64_t elapsedUs)
+{
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+	if (!out)
+		return false;
+	out.precision(std::numeric_limits<double>::max_digits10);
+	out << ResultsHeader << "\n"
+		<< "elapsed\t" << elapsedUs << "\n";
+	for (auto testInfo : tests)
+	{
+		if (testInfo->ignore)
+			continue;
+		out << "test\t" << Escape(testInfo->testName)
+			<< "\t" << (int)testInfo->status
+			<< "\t" << testInfo->elapsed
+			<< "\t" << (testInfo->benchmarked ? 1 : 0)
+			<< "\t" << testInfo->benchmarktime
+			<< "\t" << testInfo->itemsPerSecond
+			<< "\t" << Escape(testInfo->filename)
+			<< "\t" << testInfo->lineNumber
+			<< "\t" << Escape(testInfo->error)
+			<< "\n";
+		WriteDetails(out, *testInfo);
+	}
+	return (bool)out;
+}
+
+bool ReadResultsFile(const std::string& path, std::vector<ULightTestRecord>& records, int64_t& elapsedUs)
+{
+	std::ifstream in(path.c_str());
+	std::string line;
+	if (!in || !std::getline(in, line) || (line != ResultsHeader && line != ResultsHeaderV1))
+		return false;
+
+	elapsedUs = 0;
+	while (std::getline(in, line))
+	{
+		std::vector<std::string> fields;
+		std::stringstream str(line);
+		std::string field;
+		while (std::getline(str, field, '\t'))
+			fields.push_back(field);
+		if (fields.size() == 2 && fields[0] == "elapsed")
+		{
+			elapsedUs = std::strtoll(fields[1].c_str(), nullptr, 10);
+		}
+		else if (fields.size() >= 9 && fields[0] == "test")
+		{
+			ULightTestRecord record;
+			record.testName = Unescape(fields[1]);
+			record.status = std::atoi(fields[2].c_str());
+			record.elapsedUs = std::strtoll(fields[3].c_str(), nullptr, 10);
+			record.benchmarked = fields[4] == "1";
+			record.benchmarktime = std::strtoll(fields[5].c_str(), nullptr, 10);
+			record.itemsPerSecond = std::strtoll(fields[6].c_str(), nullptr, 10);
+			record.filename = Unescape(fields[7]);
+			record.lineNumber = std::atoi(fields[8].c_str());
+			if (fields.size() > 9)
+				record.error = Unescape(fields[9]);
+			records.push_back(record);
+		}
+		else if (!fields.empty() && !records.empty())
+			ReadDetail(fields, records.back());
+	}
+	return true;
+}
+
+}
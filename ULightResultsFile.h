@@ -0,0 +1,75 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightResultsFile__
+#define __ULightCpp__ULightResultsFile__
+
+#include "ULightCache.h"
+#include "ULightCheck.h"
+#include "ULightCompare.h"
+#include "ULightCounters.h"
+#include "ULightNetDriver.h"
+#include "ULightOpenLoop.h"
+#include "ULightPhases.h"
+#include "ULightSchedStats.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ULightCpp
+{
+
+struct ULightTestInfo;
+
+// One test from a results file written with --results
+struct ULightTestRecord
+{
+	ULightTestRecord()
+	 :	status(0), elapsedUs(0), benchmarked(false), benchmarktime(0), itemsPerSecond(0), lineNumber(0), compared(false)
+		{}
+
+	std::wstring testName;
+	int status;				// ULightTestStatus as an int
+	int64_t elapsedUs;
+	bool benchmarked;
+	int64_t benchmarktime;
+	int64_t itemsPerSecond;
+	std::wstring filename;
+	int lineNumber;
+	std::wstring error;
+	// Everything else the report shows, so a merged report matches the shards
+	bool compared;
+	ULightCompareResult comparison;
+	std::vector<ULightSweepPoint> sweep;
+	std::vector<ULightCounterTimeline> counters;
+	std::vector<ULightPhaseStat> phases;
+	std::vector<ULightRateResults> rates;
+	std::vector<ULightNetResults> nets;
+	std::vector<ULightTaskSched> sched;
+	std::vector<ULightCheckResult> checks;
+};
+
+// Tab separated text, one line per test followed by a line for each part of
+// its report.  Tests marked ignore are left out so a shard only writes the
+// tests it ran.
+bool WriteResultsFile(const std::string& path, const std::vector<ULightTestInfo *>& tests, int64_t elapsedUs);
+
+bool ReadResultsFile(const std::string& path, std::vector<ULightTestRecord>& records, int64_t& elapsedUs);
+
+}
+
+#endif // __ULightCpp__ULightResultsFile__
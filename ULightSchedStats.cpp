@@ -0,0 +1,145 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightSchedStats.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ULightCpp
+{
+
+static std::atomic<bool> s_schedStatsEnabled(false);
+
+void SetSchedStatsEnabled(bool enabled)
+{
+	s_schedStatsEnabled = enabled;
+}
+
+bool SchedStatsEnabled()
+{
+	return s_schedStatsEnabled;
+}
+
+#ifdef __linux__
+
+ULightSchedSample SampleThreadSched()
+{
+	ULightSchedSample sample;
+	sample.wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	char path[64];
+	long tid = syscall(SYS_gettid);
+	std::snprintf(path, sizeof(path), "/proc/self/task/%ld/schedstat", tid);
+	if (FILE *file = std::fopen(path, "r"))
+	{
+		long long cpu = 0, wait = 0;
+		if (std::fscanf(file, "%lld %lld", &cpu, &wait) == 2)
+			sample.cpuNs = cpu, sample.waitNs = wait;
+		std::fclose(file);
+	}
+
+	// Only present with CONFIG_SCHED_DEBUG
+	std::snprintf(path, sizeof(path), "/proc/self/task/%ld/sched", tid);
+	if (FILE *file = std::fopen(path, "r"))
+	{
+		char line[256];
+		while (std::fgets(line, sizeof(line), file))
+		{
+			if (std::strncmp(line, "se.nr_migrations", 16) != 0)
+				continue;
+			const char *colon = std::strchr(line, ':');
+			long long migrations = 0;
+			if (colon != nullptr && std::sscanf(colon + 1, "%lld", &migrations) == 1)
+				sample.migrations = migrations;
+			break;
+		}
+		std::fclose(file);
+	}
+
+	rusage usage;
+	if (getrusage(RUSAGE_THREAD, &usage) == 0)
+	{
+		sample.voluntary = usage.ru_nvcsw;
+		sample.involuntary = usage.ru_nivcsw;
+		if (sample.cpuNs < 0)
+		{
+			sample.cpuNs = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * (int64_t)1000000000
+				+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * (int64_t)1000;
+		}
+	}
+	return sample;
+}
+
+#else
+
+ULightSchedSample SampleThreadSched()
+{
+	ULightSchedSample sample;
+	sample.wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	return sample;
+}
+
+#endif
+
+static int64_t Delta(int64_t start, int64_t end)
+{
+	return start < 0 || end < 0 ? -1 : end - start;
+}
+
+ULightSchedSample SchedDelta(const ULightSchedSample& start, const ULightSchedSample& end)
+{
+	ULightSchedSample delta;
+	delta.wallNs = end.wallNs - start.wallNs;
+	delta.cpuNs = Delta(start.cpuNs, end.cpuNs);
+	delta.waitNs = Delta(start.waitNs, end.waitNs);
+	delta.voluntary = Delta(start.voluntary, end.voluntary);
+	delta.involuntary = Delta(start.involuntary, end.involuntary);
+	delta.migrations = Delta(start.migrations, end.migrations);
+	return delta;
+}
+
+static void AddCounter(int64_t& total, int64_t value, bool first)
+{
+	if (first)
+		total = value;
+	else if (total >= 0 && value >= 0)
+		total += value;
+	else
+		total = -1;
+}
+
+void ULightTaskSched::Add(const ULightSchedSample& sample)
+{
+	bool first = threads == 0;
+	total.wallNs += sample.wallNs;
+	AddCounter(total.cpuNs, sample.cpuNs, first);
+	AddCounter(total.waitNs, sample.waitNs, first);
+	AddCounter(total.voluntary, sample.voluntary, first);
+	AddCounter(total.involuntary, sample.involuntary, first);
+	AddCounter(total.migrations, sample.migrations, first);
+	++threads;
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightSchedStats__
+#define __ULightCpp__ULightSchedStats__
+
+#include <cstdint>
+#include <string>
+
+namespace ULightCpp
+{
+
+// Scheduler counters for one thread.  Counters the kernel does not provide
+// are -1.
+struct ULightSchedSample
+{
+	ULightSchedSample()
+	 :	wallNs(0), cpuNs(-1), waitNs(-1), voluntary(-1), involuntary(-1), migrations(-1)
+		{}
+
+	int64_t wallNs;
+	int64_t cpuNs;			// Time on a cpu
+	int64_t waitNs;			// Time runnable but waiting for a cpu
+	int64_t voluntary;		// Context switches from blocking (locks, I/O, sleeps)
+	int64_t involuntary;	// Context switches from preemption
+	int64_t migrations;		// Moves between cpus
+};
+
+// Reading the counters adds tens of microseconds to each thread start, so it
+// is only done when the statistics will be reported
+void SetSchedStatsEnabled(bool enabled);
+bool SchedStatsEnabled();
+
+// Reads the calling thread's counters from /proc/self/task/<tid>/schedstat,
+// /proc/self/task/<tid>/sched and getrusage(RUSAGE_THREAD)
+ULightSchedSample SampleThreadSched();
+
+// Counters between two samples of the same thread
+ULightSchedSample SchedDelta(const ULightSchedSample& start, const ULightSchedSample& end);
+
+// Totals for all threads of one kind of task in a test
+struct ULightTaskSched
+{
+	ULightTaskSched() : threads(0), paced(false) {}
+
+	std::wstring name;
+	size_t threads;
+	bool paced;				// Sleeps or waits on sockets between operations by design (TEST_TASK_RATE, NET_TASK)
+	ULightSchedSample total;
+
+	void Add(const ULightSchedSample& sample);
+};
+
+}
+
+#endif // __ULightCpp__ULightSchedStats__
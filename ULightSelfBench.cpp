@@ -0,0 +1,146 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+// Benchmarks of the harness's own overheads.  Build on their own with:
+//
+//     c++ -std=c++11 -O2 -pthread -DULIGHT_SELFBENCH_MAIN -o ulight-selfbench $(ls ULight*.cpp | grep -v ULightTop)
+//
+// and run with -b.
+
+#include "ULightCpp.h"
+
+UNITTESTFILE
+
+static const int SelfBenchLoops = 1000000;
+static volatile int64_t selfBenchSink;
+
+static void SelfBenchEmpty()
+{
+	selfBenchSink = selfBenchSink + 1;
+}
+
+static void SelfBenchFail()
+{
+	T(false, "Scratch failure " << selfBenchSink);
+}
+
+TEST(selfbench_timer)
+{
+	BENCHIPS(SelfBenchLoops)
+	for (int i = 0; i < SelfBenchLoops; ++i)
+	{
+		ULightCpp::ULightTestTimer timer;
+		selfBenchSink = timer.Poll();
+	}
+}
+
+TEST(selfbench_function_dispatch)
+{
+	std::function<void()> fn = SelfBenchEmpty;
+	BENCHIPS(SelfBenchLoops)
+	for (int i = 0; i < SelfBenchLoops; ++i)
+		fn();
+}
+
+TEST(selfbench_failure_path)
+{
+	const int loops = SelfBenchLoops / 10;
+	BENCHIPS(loops)
+	for (int i = 0; i < loops; ++i)
+	{
+		try
+		{
+			T(i < 0, "failure " << i);
+		}
+		catch(ULightCpp::UnitTestException ex)
+		{
+			selfBenchSink = ex.lineNumber;
+		}
+	}
+}
+
+TEST(selfbench_check_path)
+{
+	const int loops = SelfBenchLoops;
+	BENCHIPS(loops)
+	for (int i = 0; i < loops; ++i)
+		CHECK(i < 0, "failure " << i)
+	// Keep the soft failures out of this test's result
+	ULightCpp::ResetChecks();
+}
+
+TEST(selfbench_skip_path)
+{
+	const int loops = SelfBenchLoops / 10;
+	BENCHIPS(loops)
+	for (int i = 0; i < loops; ++i)
+	{
+		try
+		{
+			SKIPTEST
+		}
+		catch(ULightCpp::UnitTestSkipException skipEx)
+		{
+			selfBenchSink = i;
+		}
+	}
+}
+
+TEST(selfbench_thread_start)
+{
+	const int loops = 200;
+	const size_t threads = 8;
+	ULightCpp::ULightTestThreadStarter starter;
+	starter.add(SelfBenchEmpty, threads);
+	BENCHIPS(loops * threads)
+	for (int i = 0; i < loops; ++i)
+		selfBenchSink = starter.run().failed;
+}
+
+TEST(selfbench_report)
+{
+	// A scratch harness with a mix of passed and failed tests to format
+	static ULightCpp::ULightTests scratch;
+	static std::wstringstream out;
+	static bool initialised = false;
+	if (!initialised)
+	{
+		char name[] = "selfbench";
+		char verbose[] = "-v";
+		char *argv[] = { name, verbose };
+		scratch.Init(2, argv, out);
+		for (int i = 0; i < 100; ++i)
+		{
+			std::wstringstream testName;
+			testName << L"scratch_test_" << i;
+			scratch.AddTest(testName.str(), i % 4 == 0 ? SelfBenchFail : SelfBenchEmpty, false);
+		}
+		scratch.Execute();
+		initialised = true;
+	}
+
+	const int loops = 1000;
+	BENCHIPS(loops)
+	for (int i = 0; i < loops; ++i)
+	{
+		out.str(L"");
+		scratch.ReportToStream();
+	}
+}
+
+#ifdef ULIGHT_SELFBENCH_MAIN
+IMPLEMENT_UNITTESTS(std::wcout)
+#endif
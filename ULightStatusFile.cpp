@@ -0,0 +1,149 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightStatusFile.h"
+
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace ULightCpp
+{
+
+thread_local ULightStatusThread *t_statusThread = nullptr;
+
+static ULightStatusRegion *s_region = nullptr;
+
+static uint64_t CurrentThreadId()
+{
+#ifdef __linux__
+	return (uint64_t)syscall(SYS_gettid);
+#else
+	return (uint64_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+#endif
+}
+
+bool StatusOpen(const std::string& path)
+{
+	int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+		return false;
+	if (ftruncate(fd, sizeof(ULightStatusRegion)) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	void *mem = mmap(nullptr, sizeof(ULightStatusRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+		return false;
+
+	// A freshly truncated file reads as zeros, which is a valid initial state
+	// for every atomic in the region
+	s_region = (ULightStatusRegion *)mem;
+	s_region->version = ULightStatusVersion;
+	s_region->maxThreads = ULightStatusMaxThreads;
+	s_region->pid.store((uint64_t)getpid(), std::memory_order_relaxed);
+	s_region->startNs.store(StatusWallClockNs(), std::memory_order_relaxed);
+	s_region->state.store(StatusRunning, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	s_region->magic = ULightStatusMagic;
+
+	StatusThreadBegin();
+	return true;
+}
+
+void StatusClose()
+{
+	if (s_region == nullptr)
+		return;
+	StatusThreadEnd();
+	s_region->state.store(StatusFinished, std::memory_order_release);
+	msync(s_region, sizeof(ULightStatusRegion), MS_ASYNC);
+	munmap(s_region, sizeof(ULightStatusRegion));
+	s_region = nullptr;
+}
+
+void StatusSetTotal(size_t total)
+{
+	if (s_region != nullptr)
+		s_region->total.store(total, std::memory_order_relaxed);
+}
+
+void StatusTestBegin(const std::wstring& testName)
+{
+	if (s_region == nullptr)
+		return;
+	// Seqlock so the reader never shows a half written name
+	uint64_t seq = s_region->testSequence.load(std::memory_order_relaxed);
+	s_region->testSequence.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	size_t i = 0;
+	for (; i < testName.length() && i < ULightStatusNameLength - 1; ++i)
+		s_region->currentTest[i] = testName[i] < 128 ? (char)testName[i] : '?';
+	s_region->currentTest[i] = '\0';
+	s_region->testSequence.store(seq + 2, std::memory_order_release);
+}
+
+void StatusTestEnd(size_t passed, size_t failed, size_t skipped, size_t incomplete, int64_t elapsedUs)
+{
+	if (s_region == nullptr)
+		return;
+	s_region->passed.store(passed, std::memory_order_relaxed);
+	s_region->failed.store(failed, std::memory_order_relaxed);
+	s_region->skipped.store(skipped, std::memory_order_relaxed);
+	s_region->incomplete.store(incomplete, std::memory_order_relaxed);
+	s_region->completed.store(passed + failed + skipped + incomplete, std::memory_order_relaxed);
+	s_region->elapsedUs.store(elapsedUs, std::memory_order_relaxed);
+}
+
+void StatusThreadBegin()
+{
+	if (s_region == nullptr || t_statusThread != nullptr)
+		return;
+	uint64_t tid = CurrentThreadId();
+	for (auto& slot : s_region->threads)
+	{
+		uint64_t expected = 0;
+		if (slot.tid.compare_exchange_strong(expected, tid, std::memory_order_relaxed))
+		{
+			slot.progress.store(0, std::memory_order_relaxed);
+			// Threads that never call PROGRESS keep a zero heartbeat so
+			// ulight-top doesn't report them as stalled
+			slot.heartbeatNs.store(0, std::memory_order_relaxed);
+			t_statusThread = &slot;
+			return;
+		}
+	}
+	// All slots taken; this thread simply isn't shown
+}
+
+void StatusThreadEnd()
+{
+	if (t_statusThread == nullptr)
+		return;
+	t_statusThread->tid.store(0, std::memory_order_release);
+	t_statusThread = nullptr;
+}
+
+}
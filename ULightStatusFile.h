@@ -0,0 +1,99 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightStatusFile__
+#define __ULightCpp__ULightStatusFile__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace ULightCpp
+{
+
+// Layout of the file written with --status.  It is shared with ulight-top so
+// it must only contain fixed size, lock free fields.  Bump
+// ULightStatusVersion when changing it.
+
+static const uint64_t ULightStatusMagic = 0x5355544154534c55ULL; // "ULSTATUS"
+static const uint32_t ULightStatusVersion = 2;
+static const uint32_t ULightStatusMaxThreads = 256;
+static const uint32_t ULightStatusNameLength = 128;
+
+enum ULightStatusState { StatusRunning = 1, StatusFinished = 2 };
+
+struct ULightStatusThread
+{
+	std::atomic<uint64_t> tid;			// 0 when the slot is free
+	std::atomic<uint64_t> heartbeatNs;	// Wall clock time of the last PROGRESS, 0 before the first
+	std::atomic<uint64_t> progress;
+};
+
+struct ULightStatusRegion
+{
+	uint64_t magic;
+	uint32_t version;
+	uint32_t maxThreads;
+	std::atomic<uint64_t> pid;
+	std::atomic<uint64_t> state;
+	std::atomic<uint64_t> startNs;
+	std::atomic<uint64_t> elapsedUs;
+	std::atomic<uint64_t> total;
+	std::atomic<uint64_t> completed;
+	std::atomic<uint64_t> passed;
+	std::atomic<uint64_t> failed;
+	std::atomic<uint64_t> skipped;
+	std::atomic<uint64_t> incomplete;
+	std::atomic<uint64_t> testSequence;	// Odd while currentTest is being written
+	char currentTest[ULightStatusNameLength];
+	ULightStatusThread threads[ULightStatusMaxThreads];
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "status file needs lock free 64 bit atomics");
+
+inline uint64_t StatusWallClockNs()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Creates and maps the status file.  Returns false if it could not be created.
+bool StatusOpen(const std::string& path);
+void StatusClose();
+
+void StatusTestBegin(const std::wstring& testName);
+void StatusTestEnd(size_t passed, size_t failed, size_t skipped, size_t incomplete, int64_t elapsedUs);
+void StatusSetTotal(size_t total);
+
+// Claims and releases a heartbeat slot for the calling thread
+void StatusThreadBegin();
+void StatusThreadEnd();
+
+extern thread_local ULightStatusThread *t_statusThread;
+
+inline void StatusProgress(uint64_t count)
+{
+	ULightStatusThread *slot = t_statusThread;
+	if (slot == nullptr)
+		return;
+	// Only the owning thread writes its slot so load/store is enough
+	slot->progress.store(slot->progress.load(std::memory_order_relaxed) + count, std::memory_order_relaxed);
+	slot->heartbeatNs.store(StatusWallClockNs(), std::memory_order_relaxed);
+}
+
+}
+
+#endif // __ULightCpp__ULightStatusFile__
@@ -17,6 +17,9 @@
 #include "ULightTestTimer.h"
 #include "ULightCpp.h"
 
+#include <algorithm>
+#include <functional>
+#include <vector>
 #include <time.h>
 #include <sys/time.h>
 
@@ -28,9 +31,9 @@
 namespace ULightCpp
 {
 
-static inline int64_t ToMicroSeconds(struct timespec& tm)
+static inline int64_t ToNanoSeconds(struct timespec& tm)
 {
-	return (tm.tv_nsec / 1000) + (tm.tv_sec * 1000000);
+	return tm.tv_nsec + (tm.tv_sec * (int64_t)1000000000);
 }
 
 static inline bool portable_gettime(struct timespec& tm)
@@ -44,7 +47,7 @@ static inline bool portable_gettime(struct timespec& tm)
    	return true;
 	
 	#else
-	return clock_gettime(CLOCK_REALTIME, &tm) >= 0;
+	return clock_gettime(CLOCK_MONOTONIC, &tm) >= 0;
 	#endif
 }
 
@@ -52,7 +55,7 @@ ULightTestTimer::ULightTestTimer() : m_loopCount(0), m_unitTests(nullptr)
 {
 	struct timespec tm;
 	if (portable_gettime(tm))
-		m_bad = false, m_pit = ToMicroSeconds(tm);
+		m_bad = false, m_pit = ToNanoSeconds(tm);
 	else
 		m_bad = true;
 }
@@ -69,20 +72,75 @@ ULightTestTimer::~ULightTestTimer()
 	{
 		ULightTestInfo *testInfo = m_unitTests->GetCurrentTestInfo();
 		testInfo->benchmarked = true;
-		int64_t poll = Poll();
-		testInfo->benchmarktime = poll;
-		if (m_loopCount > 0)
-			testInfo->itemsPerSecond = ((1000000.0 / ((double)poll)) * m_loopCount);
+		int64_t poll = std::max<int64_t>(PollNs() - GetCalibration().timerNs, 0);
+		testInfo->benchmarkNs = poll;
+		testInfo->benchmarktime = poll / 1000;
+		if (m_loopCount > 0 && poll > 0)
+			testInfo->itemsPerSecond = ((1000000000.0 / ((double)poll)) * m_loopCount);
 	}
 }
 
 int64_t ULightTestTimer::Poll()
+{
+	return PollNs() / 1000;
+}
+
+int64_t ULightTestTimer::PollNs()
 {
 	struct timespec tm;
 	if (m_bad || !portable_gettime(tm))
 		return 0;
 	else
-		return ToMicroSeconds(tm) - m_pit;
+		return ToNanoSeconds(tm) - m_pit;
+}
+
+static ULightCalibration s_calibration;
+
+const ULightCalibration& GetCalibration()
+{
+	return s_calibration;
+}
+
+static volatile int s_calibrationSink;
+
+static void CalibrationTarget()
+{
+	s_calibrationSink = s_calibrationSink + 1;
+}
+
+void Calibrate()
+{
+	ULightCalibration calibration;
+
+#ifndef __MACH__
+	struct timespec res;
+	if (clock_getres(CLOCK_MONOTONIC, &res) == 0)
+		calibration.resolutionNs = ToNanoSeconds(res);
+#else
+	calibration.resolutionNs = 1000;
+#endif
+
+	// What an empty timed region measures is pure harness cost
+	const size_t samples = 5000;
+	std::vector<int64_t> empty(samples);
+	for (auto& sample : empty)
+	{
+		ULightTestTimer timer;
+		sample = timer.PollNs();
+	}
+	std::sort(empty.begin(), empty.end());
+	calibration.timerNs = empty[samples / 2];
+	int64_t spread = empty[samples * 9 / 10] - empty[samples / 10];
+
+	const int calls = 1000000;
+	std::function<void()> fn = CalibrationTarget;
+	ULightTestTimer viaFunction;
+	for (int i = 0; i < calls; ++i)
+		fn();
+	calibration.dispatchNs = viaFunction.PollNs() / calls;
+
+	calibration.noiseFloorNs = std::max(calibration.resolutionNs, calibration.timerNs + spread);
+	s_calibration = calibration;
 }
 
 }
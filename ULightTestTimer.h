@@ -36,8 +36,23 @@ public:
 	~ULightTestTimer();
 
 	int64_t Poll();
+	int64_t PollNs();
 };
 
+// Cost of the harness itself, measured once at startup when benchmarking
+struct ULightCalibration
+{
+	ULightCalibration() : resolutionNs(0), timerNs(0), dispatchNs(0), noiseFloorNs(0) {}
+
+	int64_t resolutionNs;	// Clock resolution
+	int64_t timerNs;		// Median time an empty BENCHMARK region measures
+	int64_t dispatchNs;		// Cost of one call to an empty function through std::function
+	int64_t noiseFloorNs;	// Shorter benchmarks than this are mostly harness noise
+};
+
+void Calibrate();
+const ULightCalibration& GetCalibration();
+
 }
 
 #endif // __ULightCpp__ULightTestTimer__
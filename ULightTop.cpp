@@ -0,0 +1,153 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+// ulight-top: shows the live state of a test run started with --status FILE.
+//
+// Build separately from the test executable:
+//
+//     c++ -std=c++11 -o ulight-top ULightTop.cpp
+//
+// Usage: ulight-top FILE [refresh-ms] [stall-seconds]
+
+#include "ULightStatusFile.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace ULightCpp;
+
+static std::string ReadTestName(const ULightStatusRegion *region)
+{
+	char name[ULightStatusNameLength];
+	for (;;)
+	{
+		uint64_t before = region->testSequence.load(std::memory_order_acquire);
+		std::memcpy(name, region->currentTest, sizeof(name));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		uint64_t after = region->testSequence.load(std::memory_order_relaxed);
+		if (before == after && (before & 1) == 0)
+			break;
+		std::this_thread::yield();
+	}
+	name[ULightStatusNameLength - 1] = '\0';
+	return name;
+}
+
+static void Show(const ULightStatusRegion *region, uint64_t *lastProgress, int64_t refreshMs, double stallSeconds)
+{
+	uint64_t now = StatusWallClockNs();
+	uint64_t start = region->startNs.load(std::memory_order_relaxed);
+	bool finished = region->state.load(std::memory_order_acquire) == StatusFinished;
+	double elapsed = finished ? region->elapsedUs.load(std::memory_order_relaxed) / 1e6 : (now - start) / 1e9;
+
+	std::printf("\033[H\033[2J");
+	std::printf("pid %llu  %s  elapsed %.1fs\n", (unsigned long long)region->pid.load(std::memory_order_relaxed),
+		finished ? "finished" : "running", elapsed);
+	std::printf("test      %s\n", finished ? "-" : ReadTestName(region).c_str());
+	std::printf("progress  %llu / %llu tests\n",
+		(unsigned long long)region->completed.load(std::memory_order_relaxed),
+		(unsigned long long)region->total.load(std::memory_order_relaxed));
+	std::printf("passed %llu  failed %llu  skipped %llu  incomplete %llu\n\n",
+		(unsigned long long)region->passed.load(std::memory_order_relaxed),
+		(unsigned long long)region->failed.load(std::memory_order_relaxed),
+		(unsigned long long)region->skipped.load(std::memory_order_relaxed),
+		(unsigned long long)region->incomplete.load(std::memory_order_relaxed));
+
+	std::printf("%5s %10s %14s %12s %10s\n", "slot", "tid", "progress", "rate/s", "heartbeat");
+	for (uint32_t i = 0; i < ULightStatusMaxThreads; ++i)
+	{
+		const ULightStatusThread& slot = region->threads[i];
+		uint64_t tid = slot.tid.load(std::memory_order_acquire);
+		uint64_t progress = slot.progress.load(std::memory_order_relaxed);
+		if (tid == 0)
+		{
+			lastProgress[i] = 0;
+			continue;
+		}
+		uint64_t heartbeat = slot.heartbeatNs.load(std::memory_order_relaxed);
+		double rate = progress >= lastProgress[i] ? (progress - lastProgress[i]) * 1000.0 / refreshMs : 0.0;
+		lastProgress[i] = progress;
+		if (heartbeat == 0)
+		{
+			// The thread hasn't called PROGRESS, so there is nothing to judge a stall by
+			std::printf("%5u %10llu %14llu %12.0f %10s\n", i, (unsigned long long)tid, (unsigned long long)progress, rate, "-");
+			continue;
+		}
+		double age = heartbeat < now ? (now - heartbeat) / 1e9 : 0.0;
+		std::printf("%5u %10llu %14llu %12.0f %9.1fs%s\n", i, (unsigned long long)tid, (unsigned long long)progress,
+			rate, age, age > stallSeconds ? "  STALLED" : "");
+	}
+	std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		std::fprintf(stderr, "usage: %s FILE [refresh-ms] [stall-seconds]\n", argv[0]);
+		return 2;
+	}
+	int64_t refreshMs = argc > 2 ? std::atol(argv[2]) : 1000;
+	double stallSeconds = argc > 3 ? std::atof(argv[3]) : 5.0;
+	if (refreshMs <= 0)
+		refreshMs = 1000;
+
+	int fd = open(argv[1], O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ULightStatusRegion))
+	{
+		std::fprintf(stderr, "%s: not a status file\n", argv[1]);
+		return 1;
+	}
+	void *mem = mmap(nullptr, sizeof(ULightStatusRegion), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		std::perror("mmap");
+		return 1;
+	}
+	const ULightStatusRegion *region = (const ULightStatusRegion *)mem;
+	if (region->magic != ULightStatusMagic || region->version != ULightStatusVersion)
+	{
+		std::fprintf(stderr, "%s: unsupported status file\n", argv[1]);
+		return 1;
+	}
+
+	uint64_t lastProgress[ULightStatusMaxThreads] = { 0 };
+	for (;;)
+	{
+		Show(region, lastProgress, refreshMs, stallSeconds);
+		if (region->state.load(std::memory_order_acquire) == StatusFinished)
+			break;
+		pid_t pid = (pid_t)region->pid.load(std::memory_order_relaxed);
+		if (kill(pid, 0) != 0)
+		{
+			std::printf("\nprocess %d has exited without finishing\n", (int)pid);
+			break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(refreshMs));
+	}
+	munmap(mem, sizeof(ULightStatusRegion));
+	return 0;
+}
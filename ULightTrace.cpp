@@ -0,0 +1,191 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ULightTrace.h"
+#include "ULightPhases.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+namespace ULightCpp
+{
+
+std::atomic<bool> g_traceEnabled(false);
+thread_local ULightTraceBuffer *t_traceBuffer = nullptr;
+std::atomic<uint32_t> g_traceTest(0);
+
+static const size_t FirstChunkEvents = 1024;
+static const size_t ChunkEvents = 16384;
+
+static std::mutex s_traceMutex;
+static std::vector<std::unique_ptr<ULightTraceBuffer>> s_buffers;
+static std::vector<std::wstring> s_names(1);
+static std::map<std::wstring, uint32_t> s_nameIds;
+static size_t s_maxEventsPerThread = 0;
+static int64_t s_originNs = 0;
+
+ULightTraceBuffer::ULightTraceBuffer()
+ :	tid(0), threadName(0), next(nullptr), end(nullptr), capacity(0), dropped(0)
+{
+}
+
+static ULightTraceBuffer *NewTraceBuffer()
+{
+	std::lock_guard<std::mutex> lck { s_traceMutex };
+	s_buffers.emplace_back(new ULightTraceBuffer());
+	ULightTraceBuffer *buffer = s_buffers.back().get();
+	buffer->tid = (uint32_t)s_buffers.size();
+	buffer->capacity = s_maxEventsPerThread;
+	t_traceBuffer = buffer;
+	return buffer;
+}
+
+void TraceStart(size_t maxEventsPerThread)
+{
+	{
+		std::lock_guard<std::mutex> lck { s_traceMutex };
+		s_maxEventsPerThread = std::max<size_t>(maxEventsPerThread, 1);
+		if (s_originNs == 0)
+			s_originNs = TraceNowNs();
+	}
+	TraceThreadName(TraceName(L"main"));
+	g_traceEnabled.store(true);
+}
+
+uint32_t TraceName(const std::wstring& name)
+{
+	std::lock_guard<std::mutex> lck { s_traceMutex };
+	auto it = s_nameIds.find(name);
+	if (it != s_nameIds.end())
+		return it->second;
+	uint32_t id = (uint32_t)s_names.size();
+	s_names.push_back(name);
+	s_nameIds.emplace(name, id);
+	return id;
+}
+
+void TraceThreadName(uint32_t name)
+{
+	ULightTraceBuffer *buffer = t_traceBuffer;
+	if (buffer == nullptr)
+		buffer = NewTraceBuffer();
+	buffer->threadName = name;
+}
+
+void TraceEventSlow(ULightTraceCategory category, uint32_t name, uint32_t detail, int64_t startNs, int64_t endNs)
+{
+	ULightTraceBuffer *buffer = t_traceBuffer;
+	if (buffer == nullptr)
+		buffer = NewTraceBuffer();
+	if (buffer->next == buffer->end)
+	{
+		if (buffer->capacity == 0)
+		{
+			++buffer->dropped;
+			return;
+		}
+		size_t size = std::min(buffer->chunks.empty() ? FirstChunkEvents : ChunkEvents, buffer->capacity);
+		buffer->chunks.emplace_back(new ULightTraceEvent[size]);
+		buffer->chunkSizes.push_back(size);
+		buffer->capacity -= size;
+		buffer->next = buffer->chunks.back().get();
+		buffer->end = buffer->next + size;
+	}
+	*buffer->next++ = ULightTraceEvent { category, name, detail, startNs, endNs };
+}
+
+// JSON string contents, as UTF-8 with anything unusual escaped
+static std::string JsonEscape(const std::wstring& s)
+{
+	std::string out;
+	char buf[16];
+	for (wchar_t c : s)
+	{
+		if (c == L'"' || c == L'\\')
+			out += '\\', out += (char)c;
+		else if (c >= 0x20 && c < 0x7f)
+			out += (char)c;
+		else if ((uint32_t)c > 0xffff)
+		{
+			uint32_t v = (uint32_t)c - 0x10000;
+			std::snprintf(buf, sizeof(buf), "\\u%04x\\u%04x", 0xd800 + (v >> 10), 0xdc00 + (v & 0x3ff));
+			out += buf;
+		}
+		else
+		{
+			std::snprintf(buf, sizeof(buf), "\\u%04x", (unsigned)c);
+			out += buf;
+		}
+	}
+	return out;
+}
+
+static std::string Microseconds(int64_t ns)
+{
+	char buf[32];
+	std::snprintf(buf, sizeof(buf), "%lld.%03lld", (long long)(ns / 1000), (long long)(ns % 1000));
+	return buf;
+}
+
+bool TraceWrite(const std::string& path, uint64_t& dropped)
+{
+	g_traceEnabled.store(false);
+	dropped = 0;
+
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+	if (!out)
+		return false;
+
+	static const char *categories[] = { "stage", "task", "phase", "span" };
+	std::lock_guard<std::mutex> lck { s_traceMutex };
+	out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+	bool first = true;
+	for (auto& buffer : s_buffers)
+	{
+		dropped += buffer->dropped;
+		std::wstring threadName = buffer->threadName != 0 ? s_names[buffer->threadName] : L"thread " + std::to_wstring(buffer->tid);
+		out << (first ? "" : ",\n")
+			<< "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid
+			<< ",\"args\":{\"name\":\"" << JsonEscape(threadName) << "\"}}";
+		first = false;
+
+		for (size_t chunk = 0; chunk < buffer->chunks.size(); ++chunk)
+		{
+			const ULightTraceEvent *events = buffer->chunks[chunk].get();
+			size_t count = chunk + 1 == buffer->chunks.size() ? buffer->next - events : buffer->chunkSizes[chunk];
+			for (size_t i = 0; i < count; ++i)
+			{
+				const ULightTraceEvent& event = events[i];
+				std::wstring name = event.category == ULightTraceCategory::Phase ? PhaseName(event.name) : s_names[event.name];
+				out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid
+					<< ",\"cat\":\"" << categories[(uint32_t)event.category]
+					<< "\",\"name\":\"" << JsonEscape(name)
+					<< "\",\"ts\":" << Microseconds(event.startNs - s_originNs)
+					<< ",\"dur\":" << Microseconds(std::max<int64_t>(event.endNs - event.startNs, 0));
+				if (event.detail != 0)
+					out << ",\"args\":{\"test\":\"" << JsonEscape(s_names[event.detail]) << "\"}";
+				out << "}";
+			}
+		}
+	}
+	out << "\n]}\n";
+	return (bool)out;
+}
+
+}
@@ -0,0 +1,119 @@
+/*
+	Copyright 2015 Anthony Smith
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+		http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef __ULightCpp__ULightTrace__
+#define __ULightCpp__ULightTrace__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ULightCpp
+{
+
+enum class ULightTraceCategory : uint32_t { Stage, Task, Phase, Span };
+
+// A span with both its begin and end time, so one record per span
+struct ULightTraceEvent
+{
+	ULightTraceCategory category;
+	uint32_t name;		// Phase id for phases, otherwise a TraceName id
+	uint32_t detail;	// TraceName id of the test, or 0 for none
+	int64_t startNs;
+	int64_t endNs;
+};
+
+// One per thread that records an event.  Events go into fixed size chunks so
+// recording never reallocates or moves what is already there.
+struct ULightTraceBuffer
+{
+	ULightTraceBuffer();
+
+	uint32_t tid;
+	uint32_t threadName;
+	ULightTraceEvent *next;
+	ULightTraceEvent *end;
+	size_t capacity;		// Events this thread may still allocate chunks for
+	uint64_t dropped;
+	std::vector<std::unique_ptr<ULightTraceEvent[]>> chunks;
+	std::vector<size_t> chunkSizes;
+};
+
+extern std::atomic<bool> g_traceEnabled;
+extern thread_local ULightTraceBuffer *t_traceBuffer;
+extern std::atomic<uint32_t> g_traceTest;
+
+inline int64_t TraceNowNs()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Starts recording, allowing each thread up to maxEventsPerThread events
+void TraceStart(size_t maxEventsPerThread);
+
+// Writes Chrome Trace Event JSON.  dropped is set to the number of events
+// that did not fit in their thread's buffer.
+bool TraceWrite(const std::string& path, uint64_t& dropped);
+
+uint32_t TraceName(const std::wstring& name);
+void TraceThreadName(uint32_t name);
+
+// Slow path of TraceEvent when the thread has no room left in its chunk
+void TraceEventSlow(ULightTraceCategory category, uint32_t name, uint32_t detail, int64_t startNs, int64_t endNs);
+
+inline void TraceEvent(ULightTraceCategory category, uint32_t name, uint32_t detail, int64_t startNs, int64_t endNs)
+{
+	ULightTraceBuffer *buffer = t_traceBuffer;
+	if (buffer == nullptr || buffer->next == buffer->end)
+	{
+		TraceEventSlow(category, name, detail, startNs, endNs);
+		return;
+	}
+	*buffer->next++ = ULightTraceEvent { category, name, detail, startNs, endNs };
+}
+
+// Records the rest of the scope when tracing is on.  A name of 0 records
+// nothing.
+class ULightTraceSpan
+{
+	ULightTraceCategory m_category;
+	uint32_t m_name;
+	uint32_t m_detail;
+	int64_t m_startNs;
+public:
+	ULightTraceSpan(ULightTraceCategory category, uint32_t name, uint32_t detail)
+	 :	m_category(category), m_name(name), m_detail(detail), m_startNs(0)
+	{
+		if (name != 0 && g_traceEnabled.load(std::memory_order_relaxed))
+			m_startNs = TraceNowNs();
+	}
+
+	~ULightTraceSpan()
+	{
+		if (m_startNs != 0)
+			TraceEvent(m_category, m_name, m_detail, m_startNs, TraceNowNs());
+	}
+
+	ULightTraceSpan(const ULightTraceSpan&) = delete;
+	ULightTraceSpan& operator=(const ULightTraceSpan&) = delete;
+};
+
+}
+
+#endif // __ULightCpp__ULightTrace__